@@ -0,0 +1,143 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * bloom_filter.hpp -- volatile blocked Bloom filter.
+ *
+ * All bits of a key are in one 512-bit (cache line sized) block, so a query
+ * costs a single cache miss. With 10 bits per key and 7 probes, about 1% of
+ * queries for absent keys answer "maybe". Bits are set with atomic ORs, so
+ * keys can be added while other threads query.
+ */
+
+#ifndef BLOOM_FILTER_HPP
+#define BLOOM_FILTER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace examples
+{
+
+class bloom_filter {
+public:
+	static const std::size_t BITS_PER_KEY = 10;
+	static const unsigned PROBES = 7;
+
+	/* sized for capacity keys, more can be added at a higher error rate */
+	explicit bloom_filter(std::size_t capacity)
+	    : nblocks(std::max<std::size_t>(
+		      1, (capacity * BITS_PER_KEY + BLOCK_BITS - 1) /
+			      BLOCK_BITS)),
+	      words(nblocks * BLOCK_WORDS)
+	{
+	}
+
+	void
+	add(uint64_t hash)
+	{
+		auto h = mix(hash);
+		auto block = &words[block_of(h) * BLOCK_WORDS];
+
+		for (unsigned i = 0; i < PROBES; i++) {
+			auto bit = probe(h, i);
+			block[bit / 64].fetch_or(uint64_t(1) << (bit % 64),
+						 std::memory_order_relaxed);
+		}
+	}
+
+	/* false if the hash was certainly never added */
+	bool
+	may_contain(uint64_t hash) const
+	{
+		auto h = mix(hash);
+		auto block = &words[block_of(h) * BLOCK_WORDS];
+
+		for (unsigned i = 0; i < PROBES; i++) {
+			auto bit = probe(h, i);
+			auto word = block[bit / 64].load(
+				std::memory_order_relaxed);
+			if (!(word & (uint64_t(1) << (bit % 64))))
+				return false;
+		}
+
+		return true;
+	}
+
+	/* size in bytes */
+	std::size_t
+	size() const
+	{
+		return words.size() * sizeof(uint64_t);
+	}
+
+private:
+	static const unsigned BLOCK_BITS = 512;
+	static const unsigned BLOCK_WORDS = BLOCK_BITS / 64;
+
+	/* std::hash of integers is the identity, spread the bits first */
+	static uint64_t
+	mix(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	std::size_t
+	block_of(uint64_t h) const
+	{
+		return (h >> 32) % nblocks;
+	}
+
+	/* i-th bit within the block, by double hashing of the low half */
+	static unsigned
+	probe(uint64_t h, unsigned i)
+	{
+		uint32_t a = h & 0xffff;
+		uint32_t b = ((h >> 16) & 0xffff) | 1;
+		return (a + i * b) % BLOCK_BITS;
+	}
+
+	std::size_t nblocks;
+	std::vector<std::atomic<uint64_t>> words;
+};
+
+} /* namespace examples */
+
+#endif /* BLOOM_FILTER_HPP */
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * bounded_queue.hpp -- blocking queue of limited capacity, used to connect
+ * the stages of a pipeline. Producers wait when it's full, so a slow stage
+ * throttles the ones before it.
+ */
+
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace examples
+{
+
+template <typename T>
+class bounded_queue {
+public:
+	explicit bounded_queue(std::size_t capacity) : capacity(capacity)
+	{
+	}
+
+	void
+	push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		not_full.wait(lock, [&] { return items.size() < capacity; });
+
+		items.push_back(std::move(item));
+		not_empty.notify_one();
+	}
+
+	/* returns false if the queue is closed and there's nothing left */
+	bool
+	pop(T &item)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		not_empty.wait(lock, [&] { return !items.empty() || closed; });
+
+		if (items.empty())
+			return false;
+
+		item = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+
+		return true;
+	}
+
+	/* no more items will be pushed */
+	void
+	close()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		closed = true;
+		not_empty.notify_all();
+	}
+
+private:
+	std::size_t capacity;
+	bool closed = false;
+	std::deque<T> items;
+	std::mutex mtx;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+};
+
+} /* namespace examples */
+
+#endif /* BOUNDED_QUEUE_HPP */
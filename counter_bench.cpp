@@ -0,0 +1,144 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * counter_bench.cpp -- compares scalability of a persistent counter
+ * incremented in transactions (as in warmup.cpp) with a sharded counter,
+ * with and without combining of increments, for 1 to 64 threads.
+ *
+ * create the pool for this program using pmempool, for example:
+ *	pmempool create obj --layout=counter_bench -s 100M counter_bench
+ */
+
+#include "pool_open.hpp"
+#include "sharded_counter.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <libpmemobj++/mutex.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/pext.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <thread>
+#include <vector>
+
+static const std::string LAYOUT = "counter_bench";
+
+/* size of the batches of the combining mode */
+static const uint64_t COMBINE_BATCH = 64;
+
+using pmem::obj::p;
+using pmem::obj::pool;
+using pmem::obj::transaction;
+
+using counter_type = examples::sharded_counter<64>;
+
+struct root {
+	pmem::obj::mutex mtx;
+	p<uint64_t> tx_counter;
+	counter_type sharded;
+};
+
+/* returns millions of operations per second */
+double
+run(unsigned nthreads, uint64_t ops, std::function<void()> thread_fn)
+{
+	std::vector<std::thread> threads;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned i = 0; i < nthreads; i++)
+		threads.emplace_back(thread_fn);
+
+	for (auto &t : threads)
+		t.join();
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return double(nthreads) * double(ops) / elapsed.count() / 1e6;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " file-name [ops-per-thread]"
+			  << std::endl;
+		return 1;
+	}
+
+	auto path = argv[1];
+	uint64_t ops = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000;
+
+	auto pop = examples::open_pool<root>(path, LAYOUT);
+	auto r = pop.root();
+
+	std::cout << "threads\ttx[Mops/s]\tsharded[Mops/s]\tcombining[Mops/s]"
+		  << std::endl;
+
+	for (unsigned nthreads = 1; nthreads <= 64; nthreads *= 2) {
+		auto tx = run(nthreads, ops, [&] {
+			for (uint64_t i = 0; i < ops; i++) {
+				transaction::run(pop, [&] { r->tx_counter++; },
+						 r->mtx);
+			}
+		});
+
+		auto sharded = run(nthreads, ops, [&] {
+			for (uint64_t i = 0; i < ops; i++)
+				r->sharded.add(pop);
+		});
+
+		auto combining = run(nthreads, ops, [&] {
+			examples::counter_combiner<counter_type> c(
+				pop, r->sharded, COMBINE_BATCH);
+			for (uint64_t i = 0; i < ops; i++)
+				c.add();
+		});
+
+		std::cout << nthreads << "\t" << tx << "\t" << sharded << "\t"
+			  << combining << std::endl;
+	}
+
+	std::cout << "tx counter: " << r->tx_counter
+		  << ", sharded counter: " << r->sharded.get() << std::endl;
+
+	pop.close();
+
+	return 0;
+}
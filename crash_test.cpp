@@ -0,0 +1,239 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * crash_test.cpp -- checks that the persistent queue and simplekv recover
+ * to a consistent state after a crash in the middle of an operation.
+ *
+ * Every round forks a child which runs a random mix of queue pushes and
+ * pops, kv inserts, replacements and compaction steps, kills it with
+ * SIGKILL after a random delay, reopens the pool and validates the
+ * invariants:
+ *	- head and tail of the queue agree and the queue holds exactly the
+ *	  consecutive values [popped, pushed),
+ *	- every key in the kv table is stored once, in its own bucket, and
+ *	  indexes a valid slot of values, and all keys [0, inserted) map to
+ *	  their expected values.
+ *
+ * create the pool for this program using pmempool, for example:
+ *	pmempool create obj --layout=crash_test -s 1G crash_test
+ */
+
+#include "pool_open.hpp"
+#include "queue_pmemobj_cpp.hpp"
+#include "simplekv_optimized.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <random>
+#include <signal.h>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+static const std::string LAYOUT = "crash_test";
+
+using pmem::obj::make_persistent;
+using pmem::obj::p;
+using pmem::obj::persistent_ptr;
+using pmem::obj::pool;
+using pmem::obj::transaction;
+
+using kv_type = examples::kv<int, int, 1024>;
+
+struct root {
+	examples::queue queue;
+	p<uint64_t> pushed;
+	p<uint64_t> popped;
+
+	persistent_ptr<kv_type> kv;
+	p<uint64_t> inserted;
+};
+
+bool
+contains(kv_type &kv, int key)
+{
+	return kv.find(key) != kv.end();
+}
+
+/* runs until killed */
+void
+workload(pool<root> &pop, unsigned seed)
+{
+	auto r = pop.root();
+	std::mt19937 gen(seed);
+
+	while (true) {
+		switch (gen() % 5) {
+		case 0:
+			transaction::run(pop, [&] {
+				r->queue.push(pop, static_cast<int>(r->pushed));
+				r->pushed = r->pushed + 1;
+			});
+			break;
+		case 1:
+			if (r->popped == r->pushed)
+				break;
+
+			transaction::run(pop, [&] {
+				r->queue.pop(pop);
+				r->popped = r->popped + 1;
+			});
+			break;
+		case 2: {
+			/*
+			 * the key is inserted and counted in separate
+			 * transactions, so it might be already there
+			 */
+			auto key = static_cast<int>(r->inserted);
+			if (!contains(*r->kv, key))
+				r->kv->insert(key, key * 2);
+
+			r->inserted = r->inserted + 1;
+			pop.persist(r->inserted);
+			break;
+		}
+		case 3:
+			/* replaces the value, leaving a dead slot behind */
+			if (r->inserted != 0) {
+				auto key = static_cast<int>(gen() % r->inserted);
+				r->kv->insert(key, key * 2);
+			}
+			break;
+		case 4:
+			r->kv->compact(64);
+			break;
+		}
+	}
+}
+
+/* throws std::logic_error describing the first broken invariant */
+void
+validate(pool<root> &pop)
+{
+	auto r = pop.root();
+
+	r->queue.check();
+
+	auto expected = r->popped.get_ro();
+	r->queue.for_each([&](int value) {
+		if (static_cast<uint64_t>(value) != expected)
+			throw std::logic_error("queue out of order");
+		expected++;
+	});
+
+	if (expected != r->pushed)
+		throw std::logic_error("queue does not end at the last push");
+
+	r->kv->check();
+
+	for (uint64_t key = 0; key < r->inserted; key++) {
+		auto k = static_cast<int>(key);
+		if (!contains(*r->kv, k))
+			throw std::logic_error("inserted key is missing");
+		if (r->kv->at(k) != k * 2)
+			throw std::logic_error("wrong value of a key");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [rounds [max-delay-ms]]" << std::endl;
+		return 1;
+	}
+
+	auto path = argv[1];
+	unsigned rounds = argc > 2 ? std::stoul(argv[2]) : 100;
+	unsigned max_delay = argc > 3 ? std::stoul(argv[3]) : 50;
+
+	auto pop = examples::open_pool<root>(path, LAYOUT);
+	auto r = pop.root();
+	if (r->kv == nullptr) {
+		transaction::run(pop,
+				 [&] { r->kv = make_persistent<kv_type>(); });
+	}
+	pop.close();
+
+	std::random_device rd;
+
+	for (unsigned round = 0; round < rounds; round++) {
+		auto seed = rd();
+		auto delay = std::chrono::microseconds(
+			rd() % (max_delay * 1000 + 1));
+
+		auto pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+
+		if (pid == 0) {
+			auto child = examples::open_pool<root>(path, LAYOUT);
+			workload(child, seed);
+			_exit(0);
+		}
+
+		std::this_thread::sleep_for(delay);
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+
+		pop = examples::open_pool<root>(path, LAYOUT);
+		try {
+			validate(pop);
+		} catch (std::logic_error &e) {
+			std::cerr << "round " << round << " (seed " << seed
+				  << ", killed after " << delay.count()
+				  << "us): " << e.what() << std::endl;
+			pop.close();
+			return 1;
+		}
+
+		r = pop.root();
+		std::cout << "round " << round << ": pushed " << r->pushed
+			  << ", popped " << r->popped << ", inserted "
+			  << r->inserted << ": ok" << std::endl;
+		pop.close();
+	}
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * filtered_kv.hpp -- kv with a volatile Bloom filter in front of it.
+ *
+ * A lookup of an absent key in kv hashes it, walks the whole bucket in pmem
+ * and (with at()) throws. filtered_kv::find() first asks a Bloom filter of
+ * all the keys, kept in DRAM, and answers most of such lookups without
+ * touching the pool. The filter is built from the keys when the wrapper is
+ * created, e.g. right after the pool is opened, and updated by insert().
+ * Erased keys stay in it (they only cost a pmem lookup) until rebuild().
+ *
+ * All modifications have to go through the wrapper.
+ */
+
+#ifndef FILTERED_KV_HPP
+#define FILTERED_KV_HPP
+
+#include "bloom_filter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+
+namespace examples
+{
+
+/**
+ * Kv - kv type from simplekv_optimized.hpp
+ */
+template <typename Kv>
+class filtered_kv {
+public:
+	using kv_type = Kv;
+	using key_type = typename Kv::key_type;
+	using value_type = typename Kv::value_type;
+	using iterator = typename Kv::iterator;
+
+	/* the filter gets room for at least capacity keys */
+	filtered_kv(kv_type &map, std::size_t capacity = 0)
+	    : map(map), filter(0)
+	{
+		rebuild(capacity);
+	}
+
+	/* returns base().end() if there is no such key */
+	iterator
+	find(const key_type &key)
+	{
+		lookups.fetch_add(1, std::memory_order_relaxed);
+
+		if (!filter.may_contain(std::hash<key_type>{}(key))) {
+			filtered.fetch_add(1, std::memory_order_relaxed);
+			return map.end();
+		}
+
+		auto it = map.find(key);
+		if (it == map.end())
+			false_positives.fetch_add(1,
+						  std::memory_order_relaxed);
+
+		return it;
+	}
+
+	value_type &
+	at(const key_type &key)
+	{
+		auto it = find(key);
+		if (it == map.end())
+			throw std::out_of_range("no entry in simplekv");
+
+		return *it;
+	}
+
+	void
+	insert(const key_type &key, const value_type &val)
+	{
+		/* before the kv, so a concurrent find() never misses the key */
+		filter.add(std::hash<key_type>{}(key));
+		map.insert(key, val);
+	}
+
+	bool
+	erase(const key_type &key)
+	{
+		return map.erase(key);
+	}
+
+	/*
+	 * Builds the filter again from the keys in the kv, dropping erased
+	 * ones. Nothing else may use the wrapper meanwhile.
+	 */
+	void
+	rebuild(std::size_t capacity = 0)
+	{
+		std::size_t keys = 0;
+		map.for_each_key([&](const key_type &) { keys++; });
+
+		filter = bloom_filter(std::max(keys, capacity));
+		map.for_each_key([&](const key_type &key) {
+			filter.add(std::hash<key_type>{}(key));
+		});
+	}
+
+	kv_type &
+	base() const
+	{
+		return map;
+	}
+
+	/* find() calls, misses answered by the filter, misses it let through */
+	uint64_t
+	lookup_count() const
+	{
+		return lookups.load();
+	}
+
+	uint64_t
+	filtered_count() const
+	{
+		return filtered.load();
+	}
+
+	uint64_t
+	false_positive_count() const
+	{
+		return false_positives.load();
+	}
+
+	std::size_t
+	filter_size() const
+	{
+		return filter.size();
+	}
+
+private:
+	kv_type &map;
+	bloom_filter filter;
+
+	std::atomic<uint64_t> lookups{0};
+	std::atomic<uint64_t> filtered{0};
+	std::atomic<uint64_t> false_positives{0};
+};
+
+} /* namespace examples */
+
+#endif /* FILTERED_KV_HPP */
@@ -36,6 +36,10 @@
  *
  * create the pool for this program using pmempool, for example:
  *	pmempool create obj --layout=find_bugs -s 1G find_bugs
+ *
+ * when built with -DPMEM_CHECK (make find_bugs_check) the persistent types
+ * come from pmem_check.hpp, which reports the bugs at run time and makes
+ * the program exit with a non-zero status when any were found.
  */
 
 #include <libpmemobj++/experimental/array.hpp>
@@ -48,25 +52,32 @@
 #include <libpmemobj++/pool.hpp>
 #include <libpmemobj++/transaction.hpp>
 
+#ifdef PMEM_CHECK
+#include "pmem_check.hpp"
+namespace pobj = examples::check;
+#else
+namespace pobj = pmem::obj;
+#endif
+
 static const std::string LAYOUT = "find_bugs";
 
 struct data {
 	data(): simple_variable(0), pmem_property(0), vec(10) {
-		int_ptr = pmem::obj::make_persistent<int>(10);
+		int_ptr = pobj::make_persistent<int>(10);
 	}
 
 	int simple_variable;
 
-	pmem::obj::p<int> pmem_property;
+	pobj::p<int> pmem_property;
 
-	pmem::obj::experimental::vector<int> vec;
+	pobj::experimental::vector<int> vec;
 
-	pmem::obj::persistent_ptr<int> int_ptr;
+	pobj::persistent_ptr<int> int_ptr;
 };
 
 struct root {
-	pmem::obj::persistent_ptr<data> ptr;
-	pmem::obj::persistent_ptr<data> ptr2;
+	pobj::persistent_ptr<data> ptr;
+	pobj::persistent_ptr<data> ptr2;
 };
 
 int
@@ -79,19 +90,19 @@ main(int argc, char *argv[])
 
 	auto path = argv[1];
 
-	auto pop = pmem::obj::pool<root>::open(path, LAYOUT);
+	auto pop = pobj::pool<root>::open(path, LAYOUT);
 
 	auto r = pop.root();
 	if (r->ptr == nullptr) {
-		pmem::obj::transaction::run(pop, [&] {
-			r->ptr = pmem::obj::make_persistent<data>();
-			r->ptr2 = pmem::obj::make_persistent<data>();
+		pobj::transaction::run(pop, [&] {
+			r->ptr = pobj::make_persistent<data>();
+			r->ptr2 = pobj::make_persistent<data>();
 		});
 	}
 
 	/*******************************  BUG 1  ******************************/
 
-	pmem::obj::transaction::run(pop, [&]{
+	pobj::transaction::run(pop, [&]{
 		r->ptr->simple_variable = 10;
 	});
 
@@ -101,7 +112,7 @@ main(int argc, char *argv[])
 	auto &ref = r->ptr->vec[1];
 	auto it = r->ptr->vec.begin() + 2;
 
-	pmem::obj::transaction::run(pop, [&]{
+	pobj::transaction::run(pop, [&]{
 		ref = 1;
 		*it = 2;
 	});
@@ -111,7 +122,7 @@ main(int argc, char *argv[])
 
 	r->ptr->vec.push_back(10);
 
-	pmem::obj::transaction::run(pop, [&]{
+	pobj::transaction::run(pop, [&]{
 		*(r->ptr->int_ptr) = 11;
 	});
 
@@ -133,5 +144,9 @@ main(int argc, char *argv[])
 
 	pop.close();
 
+#ifdef PMEM_CHECK
+	return examples::check::checker::instance().errors() ? 1 : 0;
+#else
 	return 0;
+#endif
 }
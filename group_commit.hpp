@@ -0,0 +1,337 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * group_commit.hpp -- asynchronous durability for writes to persistent data
+ * structures.
+ *
+ * Instead of running a transaction per write, writers append intent records
+ * to a per-thread persistent log and get a ticket back. A background thread
+ * periodically makes all new records durable with a single fence, and then
+ * applies them to the data structure in a single transaction. Writers can
+ * wait for their ticket to become durable; records which were durable
+ * before a crash are applied when the committer is started again.
+ *
+ * The data structures are not changed: a program opts into group commit
+ * by submitting records to a committer instead of calling, e.g.,
+ * queue::push() or kv::insert() directly, and by passing the committer the
+ * lock it takes around those calls elsewhere.
+ */
+
+#ifndef GROUP_COMMIT_HPP
+#define GROUP_COMMIT_HPP
+
+#include <libpmemobj++/mutex.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace examples
+{
+
+using pmem::obj::p;
+using pmem::obj::pool_base;
+using pmem::obj::transaction;
+
+/**
+ * Persistent part of the group commit: ring buffers of records.
+ *
+ * Record - trivially copyable description of a write
+ * Logs - number of logs, threads above that share them
+ * Capacity - number of records in each log
+ */
+template <typename Record, std::size_t Logs = 16, std::size_t Capacity = 1024>
+struct intent_log {
+	static_assert(std::is_trivially_copyable<Record>::value,
+		      "records have to be trivially copyable");
+
+	using record_type = Record;
+	static const std::size_t LOGS = Logs;
+	static const std::size_t CAPACITY = Capacity;
+
+	struct log {
+		/* records [applied, durable) still have to be applied */
+		p<uint64_t> applied;
+		uint64_t durable;
+
+		Record records[Capacity];
+	};
+
+	log logs[Logs];
+};
+
+struct commit_ticket {
+	std::size_t log;
+	uint64_t seq;
+};
+
+/**
+ * Volatile part of the group commit, running the background committer.
+ *
+ * Log - intent_log instantiation
+ * Apply - function applying a single record, called inside a transaction
+ *	which holds the lock passed to the constructor, if any
+ */
+template <typename Log, typename Apply>
+class group_committer {
+public:
+	using record_type = typename Log::record_type;
+
+	group_committer(pool_base &pop, Log &plog, Apply apply,
+			pmem::obj::mutex *lock = nullptr,
+			std::chrono::microseconds interval =
+				std::chrono::microseconds(100))
+	    : pop(pop), plog(plog), apply(apply), lock(lock),
+	      interval(interval), state(Log::LOGS)
+	{
+		for (std::size_t i = 0; i < Log::LOGS; i++) {
+			state[i].written = plog.logs[i].durable;
+			state[i].durable = plog.logs[i].durable;
+			state[i].applied = plog.logs[i].applied;
+		}
+
+		/* recovery of records made durable before a crash */
+		apply_durable();
+
+		committer = std::thread([&] { run(); });
+	}
+
+	/* makes all submitted records durable and applies them */
+	~group_committer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopped = true;
+		}
+		work.notify_one();
+		committer.join();
+	}
+
+	/* appends the record to the calling thread's log */
+	commit_ticket
+	submit(const record_type &record)
+	{
+		auto i = thread_log();
+		auto &l = plog.logs[i];
+		auto &s = state[i];
+
+		std::unique_lock<std::mutex> lock(s.mtx);
+		s.space.wait(lock, [&] {
+			return s.written - s.applied.load() < Log::CAPACITY;
+		});
+
+		l.records[s.written % Log::CAPACITY] = record;
+
+		return commit_ticket{i, ++s.written};
+	}
+
+	/* waits until the record of the ticket is durable */
+	void
+	wait(const commit_ticket &t)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		if (state[t.log].durable.load() < t.seq) {
+			waiting++;
+			work.notify_one();
+			durable.wait(lock, [&] {
+				return state[t.log].durable.load() >= t.seq;
+			});
+			waiting--;
+		}
+	}
+
+	/* waits until all records submitted so far are durable */
+	void
+	sync()
+	{
+		for (std::size_t i = 0; i < Log::LOGS; i++) {
+			uint64_t written;
+			{
+				std::lock_guard<std::mutex> lock(state[i].mtx);
+				written = state[i].written;
+			}
+			wait(commit_ticket{i, written});
+		}
+	}
+
+private:
+	struct log_state {
+		std::mutex mtx;
+		std::condition_variable space;
+		uint64_t written = 0;
+		std::atomic<uint64_t> durable{0};
+		std::atomic<uint64_t> applied{0};
+	};
+
+	static std::size_t
+	thread_log()
+	{
+		static std::atomic<std::size_t> next{0};
+		static thread_local std::size_t index = next++ % Log::LOGS;
+
+		return index;
+	}
+
+	void
+	run()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		for (;;) {
+			if (!stopped && waiting == 0)
+				work.wait_for(lock, interval);
+
+			bool last = stopped;
+
+			lock.unlock();
+			commit();
+			lock.lock();
+
+			if (last)
+				return;
+		}
+	}
+
+	/* flushes records in [from, to) of the log, without a fence */
+	void
+	flush(typename Log::log &l, uint64_t from, uint64_t to)
+	{
+		while (from < to) {
+			auto i = from % Log::CAPACITY;
+			auto n = std::min<uint64_t>(to - from, Log::CAPACITY - i);
+
+			pop.flush(&l.records[i], n * sizeof(record_type));
+			from += n;
+		}
+	}
+
+	void
+	commit()
+	{
+		std::vector<uint64_t> written(Log::LOGS);
+		bool any = false;
+
+		for (std::size_t i = 0; i < Log::LOGS; i++) {
+			{
+				std::lock_guard<std::mutex> lock(state[i].mtx);
+				written[i] = state[i].written;
+			}
+
+			if (written[i] != state[i].durable) {
+				flush(plog.logs[i], state[i].durable,
+				      written[i]);
+				any = true;
+			}
+		}
+
+		if (!any)
+			return;
+
+		/* one fence for the records of all the logs */
+		pop.drain();
+
+		for (std::size_t i = 0; i < Log::LOGS; i++) {
+			plog.logs[i].durable = written[i];
+			pop.flush(&plog.logs[i].durable, sizeof(uint64_t));
+		}
+		pop.drain();
+
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			for (std::size_t i = 0; i < Log::LOGS; i++)
+				state[i].durable = written[i];
+		}
+		durable.notify_all();
+
+		apply_durable();
+	}
+
+	/* applies all durable records in a single transaction */
+	void
+	apply_durable()
+	{
+		auto tx = [&] {
+			for (std::size_t i = 0; i < Log::LOGS; i++) {
+				auto &l = plog.logs[i];
+				if (l.applied == l.durable)
+					continue;
+
+				for (uint64_t seq = l.applied; seq < l.durable;
+				     seq++)
+					apply(l.records[seq % Log::CAPACITY]);
+
+				l.applied = l.durable;
+			}
+		};
+
+		if (lock)
+			transaction::run(pop, tx, *lock);
+		else
+			transaction::run(pop, tx);
+
+		for (std::size_t i = 0; i < Log::LOGS; i++) {
+			std::lock_guard<std::mutex> lock(state[i].mtx);
+			state[i].applied = plog.logs[i].applied;
+			state[i].space.notify_all();
+		}
+	}
+
+	pool_base &pop;
+	Log &plog;
+	Apply apply;
+	/* taken by the transaction applying the records */
+	pmem::obj::mutex *lock;
+	std::chrono::microseconds interval;
+
+	std::vector<log_state> state;
+
+	/* protects stopped, waiting and durability notifications */
+	std::mutex mtx;
+	std::condition_variable work;
+	std::condition_variable durable;
+	bool stopped = false;
+	unsigned waiting = 0;
+
+	std::thread committer;
+};
+
+} /* namespace examples */
+
+#endif /* GROUP_COMMIT_HPP */
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * group_commit_bench.cpp -- compares queue pushes and kv inserts done in a
+ * transaction each with the same writes done through group commit
+ * (group_commit.hpp), for 1 to 16 threads.
+ *
+ * create the pool for this program using pmempool, for example:
+ *	pmempool create obj --layout=group_commit -s 1G group_commit_pool
+ */
+
+#include "group_commit.hpp"
+#include "pool_open.hpp"
+#include "queue_pmemobj_cpp.hpp"
+#include "simplekv_optimized.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/mutex.hpp>
+#include <thread>
+#include <vector>
+
+static const std::string LAYOUT = "group_commit";
+
+using pmem::obj::make_persistent;
+using pmem::obj::persistent_ptr;
+using pmem::obj::pool;
+using pmem::obj::transaction;
+
+using simplekv_type = examples::kv<int, int, 1024>;
+
+struct kv_record {
+	int key;
+	int value;
+};
+
+using queue_log_type = examples::intent_log<int>;
+using kv_log_type = examples::intent_log<kv_record>;
+
+struct root {
+	pmem::obj::mutex mtx;
+	examples::queue queue;
+	persistent_ptr<simplekv_type> simplekv;
+	persistent_ptr<queue_log_type> queue_log;
+	persistent_ptr<kv_log_type> kv_log;
+};
+
+/* returns thousands of operations per second */
+double
+run(unsigned nthreads, int ops, std::function<void(int)> op,
+    std::function<void()> finish)
+{
+	std::vector<std::thread> threads;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned t = 0; t < nthreads; t++) {
+		threads.emplace_back([&, t] {
+			for (int i = 0; i < ops; i++)
+				op(int(t) * ops + i);
+		});
+	}
+
+	for (auto &t : threads)
+		t.join();
+
+	finish();
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return double(nthreads) * ops / elapsed.count() / 1e3;
+}
+
+void
+bench(pool<root> &pop, int ops)
+{
+	auto r = pop.root();
+
+	using queue_committer = examples::group_committer<
+		queue_log_type, std::function<void(const int &)>>;
+	using kv_committer = examples::group_committer<
+		kv_log_type, std::function<void(const kv_record &)>>;
+
+	queue_committer qc(pop, *r->queue_log,
+			   [&](const int &v) { r->queue.push(pop, v); },
+			   &r->mtx);
+	kv_committer kc(pop, *r->kv_log,
+			[&](const kv_record &rec) {
+				r->simplekv->insert(rec.key, rec.value);
+			},
+			&r->mtx);
+
+	auto queue_push = [&](int v) {
+		transaction::run(pop, [&] { r->queue.push(pop, v); }, r->mtx);
+	};
+	auto kv_insert = [&](int v) {
+		transaction::run(pop, [&] { r->simplekv->insert(v, v); },
+				 r->mtx);
+	};
+
+	std::cout << "threads\tqueue tx[Kops/s]\tqueue group[Kops/s]"
+		  << "\tkv tx[Kops/s]\tkv group[Kops/s]" << std::endl;
+
+	for (unsigned nthreads = 1; nthreads <= 16; nthreads *= 2) {
+		auto queue_tx = run(nthreads, ops, queue_push, [] {});
+		auto queue_group = run(nthreads, ops,
+				       [&](int v) { qc.submit(v); },
+				       [&] { qc.sync(); });
+
+		auto kv_tx = run(nthreads, ops, kv_insert, [] {});
+		auto kv_group = run(nthreads, ops,
+				    [&](int v) { kc.submit(kv_record{v, v}); },
+				    [&] { kc.sync(); });
+
+		std::cout << nthreads << "\t" << queue_tx << "\t"
+			  << queue_group << "\t" << kv_tx << "\t" << kv_group
+			  << std::endl;
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " file-name [ops-per-thread]"
+			  << std::endl;
+		return 1;
+	}
+
+	auto path = argv[1];
+	int ops = argc > 2 ? std::atoi(argv[2]) : 10000;
+
+	auto pop = examples::open_pool<root>(path, LAYOUT);
+	auto r = pop.root();
+
+	if (r->simplekv == nullptr) {
+		transaction::run(pop, [&] {
+			r->simplekv = make_persistent<simplekv_type>();
+			r->queue_log = make_persistent<queue_log_type>();
+			r->kv_log = make_persistent<kv_log_type>();
+		});
+	}
+
+	bench(pop, ops);
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * heavy_hitters.hpp -- streaming top-k / frequency threshold selection
+ * based on a count-min sketch and a bounded set of candidates.
+ */
+
+#ifndef HEAVY_HITTERS_HPP
+#define HEAVY_HITTERS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace examples
+{
+
+/**
+ * Count-min sketch with conservative update. Estimates never undercount,
+ * memory usage is width * depth counters regardless of the number of keys.
+ */
+template <typename Key, typename Hash = std::hash<Key>>
+class count_min_sketch {
+public:
+	count_min_sketch(std::size_t width, std::size_t depth)
+	    : width(width), depth(depth), counters(width * depth, 0)
+	{
+	}
+
+	/* adds n occurrences of key, returns the new estimate */
+	uint64_t
+	add(const Key &key, uint64_t n = 1)
+	{
+		auto h = Hash{}(key);
+		auto est = estimate(h) + n;
+
+		for (std::size_t row = 0; row < depth; row++) {
+			auto &c = counters[slot(h, row)];
+			c = std::max(c, est);
+		}
+
+		return est;
+	}
+
+	uint64_t
+	estimate(const Key &key) const
+	{
+		return estimate(Hash{}(key));
+	}
+
+private:
+	static uint64_t
+	mix(uint64_t x)
+	{
+		/* splitmix64 finalizer */
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ULL;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebULL;
+		x ^= x >> 31;
+		return x;
+	}
+
+	std::size_t
+	slot(uint64_t h, std::size_t row) const
+	{
+		return row * width + mix(h + row * 0x9e3779b97f4a7c15ULL) % width;
+	}
+
+	uint64_t
+	estimate(uint64_t h) const
+	{
+		auto est = std::numeric_limits<uint64_t>::max();
+
+		for (std::size_t row = 0; row < depth; row++)
+			est = std::min(est, counters[slot(h, row)]);
+
+		return est;
+	}
+
+	std::size_t width;
+	std::size_t depth;
+	std::vector<uint64_t> counters;
+};
+
+/**
+ * Keeps at most capacity keys with the highest estimated counts, ignoring
+ * keys estimated below threshold. Estimates come from a count-min sketch,
+ * so the candidates have to be recounted exactly to get real counts.
+ */
+template <typename Key, typename Hash = std::hash<Key>>
+class heavy_hitters {
+public:
+	heavy_hitters(std::size_t capacity, uint64_t threshold = 0,
+		      std::size_t width = (1 << 16), std::size_t depth = 4)
+	    : capacity(capacity), threshold(threshold), sketch(width, depth)
+	{
+	}
+
+	void
+	add(const Key &key)
+	{
+		auto est = sketch.add(key);
+		if (est < threshold || capacity == 0)
+			return;
+
+		auto it = estimates.find(key);
+		if (it != estimates.end()) {
+			order.erase(std::make_pair(it->second, key));
+			it->second = est;
+			order.emplace(est, key);
+			return;
+		}
+
+		if (estimates.size() == capacity) {
+			auto lowest = order.begin();
+			if (lowest->first >= est)
+				return;
+
+			estimates.erase(lowest->second);
+			order.erase(lowest);
+		}
+
+		estimates.emplace(key, est);
+		order.emplace(est, key);
+	}
+
+	/* returns candidate keys, each mapped to an exact count of zero */
+	std::unordered_map<Key, uint64_t, Hash>
+	candidates() const
+	{
+		std::unordered_map<Key, uint64_t, Hash> ret;
+
+		for (const auto &e : estimates)
+			ret.emplace(e.first, 0);
+
+		return ret;
+	}
+
+private:
+	std::size_t capacity;
+	uint64_t threshold;
+	count_min_sketch<Key, Hash> sketch;
+	std::unordered_map<Key, uint64_t, Hash> estimates;
+	std::set<std::pair<uint64_t, Key>> order;
+};
+
+/**
+ * Returns up to k entries (all if k == 0) with count >= min_count,
+ * sorted by count, descending.
+ */
+template <typename Map>
+std::vector<std::pair<typename Map::key_type, uint64_t>>
+select_top(const Map &counts, std::size_t k, uint64_t min_count)
+{
+	using entry = std::pair<typename Map::key_type, uint64_t>;
+
+	std::vector<entry> ret;
+	for (const auto &e : counts) {
+		if (e.second >= min_count)
+			ret.emplace_back(e.first, e.second);
+	}
+
+	auto by_count = [](const entry &a, const entry &b) {
+		return a.second > b.second ||
+			(a.second == b.second && a.first < b.first);
+	};
+
+	if (k != 0 && k < ret.size()) {
+		std::partial_sort(ret.begin(), ret.begin() + k, ret.end(),
+				  by_count);
+		ret.resize(k);
+	} else {
+		std::sort(ret.begin(), ret.end(), by_count);
+	}
+
+	return ret;
+}
+
+} /* namespace examples */
+
+#endif /* HEAVY_HITTERS_HPP */
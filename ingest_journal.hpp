@@ -0,0 +1,161 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * ingest_journal.hpp -- persistent record of which input files were already
+ * ingested, and how far.
+ *
+ * Every file is identified by its path, size and modification time. The
+ * journal entry is updated in the same transaction as the data read from
+ * the file, so after a crash ingestion can resume from the last committed
+ * offset and finished files are not ingested twice.
+ */
+
+#ifndef INGEST_JOURNAL_HPP
+#define INGEST_JOURNAL_HPP
+
+#include <libpmemobj++/experimental/string.hpp>
+#include <libpmemobj++/experimental/vector.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <cstdint>
+#include <string>
+#include <sys/stat.h>
+
+namespace examples
+{
+
+namespace ptl = pmem::obj::experimental;
+
+using pmem::obj::make_persistent;
+using pmem::obj::p;
+using pmem::obj::persistent_ptr;
+
+struct file_id {
+	uint64_t size;
+	uint64_t mtime; /* nanoseconds */
+
+	/* returns false if the file cannot be accessed */
+	static bool
+	of(const std::string &path, file_id &id)
+	{
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0)
+			return false;
+
+		id.size = static_cast<uint64_t>(st.st_size);
+		id.mtime = static_cast<uint64_t>(st.st_mtim.tv_sec) *
+				1000000000ULL +
+			static_cast<uint64_t>(st.st_mtim.tv_nsec);
+
+		return true;
+	}
+};
+
+/**
+ * Data - type of the persistent object the file is ingested into
+ */
+template <typename Data>
+struct journal_entry {
+	journal_entry(const std::string &path, const file_id &id)
+	    : path(path), size(id.size), mtime(id.mtime), offset(0), done(0)
+	{
+	}
+
+	bool
+	matches(const file_id &id) const
+	{
+		return size == id.size && mtime == id.mtime;
+	}
+
+	/* starts over, has to be called inside a transaction */
+	void
+	reset(const file_id &id)
+	{
+		size = id.size;
+		mtime = id.mtime;
+		offset = 0;
+		done = 0;
+	}
+
+	ptl::string path;
+	p<uint64_t> size;
+	p<uint64_t> mtime;
+
+	/* bytes of the file already committed */
+	p<uint64_t> offset;
+	p<uint64_t> done;
+
+	persistent_ptr<Data> data;
+};
+
+template <typename Data>
+class ingest_journal {
+public:
+	using entry_type = journal_entry<Data>;
+
+	persistent_ptr<entry_type>
+	find(const std::string &path) const
+	{
+		for (const auto &e : entries) {
+			if (path.compare(e->path.c_str()) == 0)
+				return e;
+		}
+
+		return nullptr;
+	}
+
+	/* has to be called inside a transaction */
+	persistent_ptr<entry_type>
+	add(const std::string &path, const file_id &id)
+	{
+		auto e = make_persistent<entry_type>(path, id);
+		entries.push_back(e);
+
+		return e;
+	}
+
+	const ptl::vector<persistent_ptr<entry_type>> &
+	all() const
+	{
+		return entries;
+	}
+
+private:
+	ptl::vector<persistent_ptr<entry_type>> entries;
+};
+
+} /* namespace examples */
+
+#endif /* INGEST_JOURNAL_HPP */
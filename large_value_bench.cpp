@@ -0,0 +1,211 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * large_value_bench.cpp -- compares appending values of various sizes to a
+ * vector in a transaction (undo logged) with appending them as segments of
+ * a segmented_array (written once, then published), and with pushing them
+ * as messages of a blob queue (inline in the node, published the same way
+ * if large enough).
+ *
+ * The undo logged path writes every byte twice: to the log and in place.
+ * Next to the throughput, the bytes written per payload byte of each path
+ * are printed: the payload (and message header) plus the log space
+ * libpmemobj needs for the snapshots and actions of one append, which
+ * bounds what goes to the logs. To see the writes on the media, compare
+ * the counters before and after a run of:
+ *	ipmctl show -dimm -performance MediaWrites
+ *
+ * create the pool for this program using pmempool, for example:
+ *	pmempool create obj --layout=large_value -s 1G large_value_pool
+ */
+
+#include "pool_open.hpp"
+#include "queue_pmemobj_cpp.hpp"
+#include "segmented_array.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <libpmemobj.h>
+#include <libpmemobj++/experimental/vector.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <vector>
+
+static const std::string LAYOUT = "large_value";
+
+namespace ptl = pmem::obj::experimental;
+
+using pmem::obj::delete_persistent;
+using pmem::obj::make_persistent;
+using pmem::obj::persistent_ptr;
+using pmem::obj::pool;
+using pmem::obj::transaction;
+
+using vector_type = ptl::vector<uint32_t>;
+using array_type = examples::segmented_array<uint32_t>;
+
+struct root {
+	persistent_ptr<vector_type> vec;
+	persistent_ptr<array_type> arr;
+	examples::blob_queue blobs;
+};
+
+/* returns MB/s of appended data */
+double
+run(std::size_t total, std::size_t value_size, std::function<void()> append)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (std::size_t written = 0; written < total; written += value_size)
+		append();
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return double(total) / elapsed.count() / (1 << 20);
+}
+
+/*
+ * returns bytes written per payload byte by an append of payload bytes,
+ * which also writes extra bytes in place, snapshots ranges of the given
+ * sizes to the undo log and needs intents actions in the redo log
+ */
+double
+written_per_byte(std::size_t payload, std::size_t extra,
+		 std::vector<std::size_t> snapshots, std::size_t intents)
+{
+	std::size_t log = 0;
+	if (!snapshots.empty())
+		log += pmemobj_tx_log_snapshots_max_size(snapshots.data(),
+							 snapshots.size());
+	if (intents != 0)
+		log += pmemobj_tx_log_intents_max_size(intents);
+
+	return double(payload + extra + log) / payload;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " file-name [total-MB]"
+			  << std::endl;
+		return 1;
+	}
+
+	auto path = argv[1];
+	std::size_t total =
+		(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 64) << 20;
+
+	auto pop = examples::open_pool<root>(path, LAYOUT);
+	auto r = pop.root();
+
+	std::cout << "value size[B]\tundo log[MB/s]\tsegments[MB/s]"
+		  << "\tblob queue[MB/s]\tundo log[B/B]\tsegments[B/B]"
+		  << "\tblob queue[B/B]" << std::endl;
+
+	const std::size_t ptr_size = sizeof(PMEMoid);
+	const std::size_t size_size = sizeof(uint64_t);
+
+	for (std::size_t size = 1 << 10; size <= (1 << 20); size <<= 2) {
+		std::vector<uint32_t> value(size / sizeof(uint32_t), 42);
+
+		transaction::run(pop, [&] {
+			r->vec = make_persistent<vector_type>();
+			r->arr = make_persistent<array_type>();
+
+			/* exclude reallocations from the measurement */
+			r->vec->reserve(total / sizeof(uint32_t));
+		});
+
+		auto undo = run(total, size, [&] {
+			transaction::run(pop, [&] {
+				r->vec->insert(r->vec->end(), value.begin(),
+					       value.end());
+			});
+		});
+
+		auto segments = run(total, size, [&] {
+			examples::segment_reservation<uint32_t> res(
+				pop, value.data(), value.size());
+
+			transaction::run(pop, [&] { r->arr->append(res); });
+		});
+
+		auto blobs = run(total, size, [&] {
+			r->blobs.push(pop, value.data(), size);
+		});
+
+		while (r->blobs.size() != 0)
+			r->blobs.pop(pop);
+
+		transaction::run(pop, [&] {
+			r->arr->clear();
+			delete_persistent<array_type>(r->arr);
+			delete_persistent<vector_type>(r->vec);
+			r->arr = nullptr;
+			r->vec = nullptr;
+		});
+
+		/* the appended range and the vector's size */
+		auto undo_written =
+			written_per_byte(size, 0, {size, size_size}, 0);
+
+		/* the new segment, the array's sizes and publishing it */
+		auto segments_written = written_per_byte(
+			size, 0,
+			{sizeof(array_type::segment), size_size, size_size,
+			 size_size},
+			1);
+
+		/* the node header, linking it and its allocation */
+		auto blobs_written =
+			written_per_byte(size, sizeof(examples::blob_node),
+					 {ptr_size, ptr_size, size_size}, 1);
+
+		std::cout << size << "\t" << undo << "\t" << segments << "\t"
+			  << blobs << "\t" << undo_written << "\t"
+			  << segments_written << "\t" << blobs_written
+			  << std::endl;
+	}
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * latency_histogram.hpp -- HDR-style histogram of operation latencies.
+ *
+ * Values below 2^SUB_BITS nanoseconds have their own buckets, larger ones
+ * are grouped by their most significant bit into 2^(SUB_BITS - 1) linear
+ * sub-buckets, so every value is recorded with a relative error below
+ * 2^-(SUB_BITS - 1) in constant time and memory, without any allocation.
+ */
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+
+namespace examples
+{
+
+class latency_histogram {
+public:
+	using clock = std::chrono::steady_clock;
+
+	static const unsigned SUB_BITS = 5;
+	static const std::size_t BUCKETS = (64 - SUB_BITS + 2)
+		<< (SUB_BITS - 1);
+
+	latency_histogram()
+	{
+		std::fill(buckets, buckets + BUCKETS, 0);
+	}
+
+	void
+	record(uint64_t ns)
+	{
+		buckets[index(ns)]++;
+		total++;
+		min_ns = std::min(min_ns, ns);
+		max_ns = std::max(max_ns, ns);
+	}
+
+	/* records time elapsed since start */
+	void
+	record(clock::time_point start)
+	{
+		auto elapsed = clock::now() - start;
+		record(static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(
+				elapsed)
+				.count()));
+	}
+
+	uint64_t
+	count() const
+	{
+		return total;
+	}
+
+	uint64_t
+	min() const
+	{
+		return total ? min_ns : 0;
+	}
+
+	uint64_t
+	max() const
+	{
+		return max_ns;
+	}
+
+	/* smallest value not exceeded by the q (0..1) part of the samples */
+	uint64_t
+	percentile(double q) const
+	{
+		if (total == 0)
+			return 0;
+
+		auto rank = static_cast<uint64_t>(std::ceil(q * total));
+		rank = std::max<uint64_t>(rank, 1);
+
+		uint64_t seen = 0;
+		for (std::size_t i = 0; i < BUCKETS; i++) {
+			seen += buckets[i];
+			if (seen >= rank)
+				return std::min(highest(i), max_ns);
+		}
+
+		return max_ns;
+	}
+
+	/* prints e.g. "push: ops 10 p50 812ns p99 2303ns max 2310ns" */
+	void
+	print(std::ostream &os, const char *name) const
+	{
+		os << name << ": ops " << count() << " p50 " << percentile(0.5)
+		   << "ns p99 " << percentile(0.99) << "ns max " << max()
+		   << "ns" << std::endl;
+	}
+
+private:
+	static std::size_t
+	index(uint64_t v)
+	{
+		if (v < (1ULL << SUB_BITS))
+			return static_cast<std::size_t>(v);
+
+		unsigned shift = 64 - __builtin_clzll(v) - SUB_BITS;
+		return (shift << (SUB_BITS - 1)) + (v >> shift);
+	}
+
+	/* highest value which falls into bucket i */
+	static uint64_t
+	highest(std::size_t i)
+	{
+		if (i < (1ULL << SUB_BITS))
+			return i;
+
+		unsigned shift = (i >> (SUB_BITS - 1)) - 1;
+		uint64_t m = (i & ((1ULL << (SUB_BITS - 1)) - 1)) +
+			(1ULL << (SUB_BITS - 1));
+
+		return ((m + 1) << shift) - 1;
+	}
+
+	uint64_t buckets[BUCKETS];
+	uint64_t total = 0;
+	uint64_t min_ns = std::numeric_limits<uint64_t>::max();
+	uint64_t max_ns = 0;
+};
+
+} /* namespace examples */
+
+#endif /* LATENCY_HISTOGRAM_HPP */
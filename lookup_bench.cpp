@@ -0,0 +1,208 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * lookup_bench.cpp -- lookups in a kv with a given share of absent keys:
+ * with at(), which throws on a miss, with find(), with find() of
+ * filtered_kv, which answers most misses from a Bloom filter in DRAM, and
+ * with find_batch(), which interleaves the lookups of a batch of keys so
+ * that their loads from pmem overlap. The table has 2^16 buckets; with
+ * millions of keys it's far bigger than the CPU caches.
+ *
+ * create the pool for this program using pmempool, for example:
+ *	pmempool create obj --layout=lookup_bench -s 1G lookup_pool
+ */
+
+#include "filtered_kv.hpp"
+#include "pool_open.hpp"
+#include "simplekv_optimized.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+static const std::string LAYOUT = "lookup_bench";
+
+/* keys passed to a single find_batch() call */
+static const std::size_t LOOKUP_BATCH = 256;
+
+using pmem::obj::make_persistent;
+using pmem::obj::persistent_ptr;
+using pmem::obj::pool;
+using pmem::obj::transaction;
+
+using kv_type = examples::kv<uint64_t, uint64_t, (1 << 16)>;
+using filtered_type = examples::filtered_kv<kv_type>;
+
+struct root {
+	persistent_ptr<kv_type> kv;
+};
+
+/* returns ns per lookup, found counts the keys which were present */
+double
+run(const std::vector<uint64_t> &keys, uint64_t &found,
+    std::function<bool(uint64_t)> lookup)
+{
+	found = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for (auto k : keys)
+		found += lookup(k);
+
+	std::chrono::duration<double, std::nano> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return elapsed.count() / keys.size();
+}
+
+/* the same for lookups of whole batches, which return the number found */
+double
+run_batch(const std::vector<uint64_t> &keys, uint64_t &found,
+	  std::function<uint64_t(const uint64_t *, std::size_t)> lookup)
+{
+	found = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for (std::size_t i = 0; i < keys.size(); i += LOOKUP_BATCH)
+		found += lookup(&keys[i],
+				std::min(LOOKUP_BATCH, keys.size() - i));
+
+	std::chrono::duration<double, std::nano> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return elapsed.count() / keys.size();
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [keys [lookups [miss-%]]]"
+			  << std::endl;
+		return 1;
+	}
+
+	auto path = argv[1];
+	uint64_t nkeys =
+		argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000;
+	uint64_t nlookups =
+		argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1000000;
+	unsigned miss = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 40;
+
+	if (nkeys == 0 || nlookups == 0) {
+		std::cerr << "keys and lookups have to be at least 1"
+			  << std::endl;
+		return 1;
+	}
+
+	auto pop = examples::open_pool<root>(path, LAYOUT);
+	auto r = pop.root();
+
+	if (r->kv == nullptr) {
+		transaction::run(pop,
+				 [&] { r->kv = make_persistent<kv_type>(); });
+	}
+
+	/* present keys are even, absent ones odd */
+	for (uint64_t i = 0; i < nkeys; i++) {
+		if (r->kv->find(2 * i) == r->kv->end())
+			r->kv->insert(2 * i, i);
+	}
+
+	std::mt19937_64 gen(42);
+	std::vector<uint64_t> keys(nlookups);
+	for (auto &k : keys)
+		k = 2 * (gen() % nkeys) + (gen() % 100 < miss);
+
+	filtered_type filtered(*r->kv, nkeys);
+	uint64_t found[4];
+
+	auto at = run(keys, found[0], [&](uint64_t k) {
+		try {
+			r->kv->at(k);
+			return true;
+		} catch (std::out_of_range &) {
+			return false;
+		}
+	});
+
+	auto find = run(keys, found[1], [&](uint64_t k) {
+		return r->kv->find(k) != r->kv->end();
+	});
+
+	auto filtered_find = run(keys, found[2], [&](uint64_t k) {
+		return filtered.find(k) != r->kv->end();
+	});
+
+	std::vector<kv_type::iterator> its;
+	auto find_batch = run_batch(
+		keys, found[3], [&](const uint64_t *batch, std::size_t n) {
+			r->kv->find_batch(batch, n, its);
+
+			uint64_t hits = 0;
+			for (auto &it : its)
+				hits += it != r->kv->end();
+			return hits;
+		});
+
+	if (found[0] != found[1] || found[1] != found[2] ||
+	    found[2] != found[3]) {
+		std::cerr << "lookups disagree" << std::endl;
+		return 1;
+	}
+
+	std::cout << "keys " << nkeys << ", lookups " << nlookups << ", misses "
+		  << nlookups - found[0] << std::endl;
+	std::cout << "at()[ns]\tfind()[ns]\tfiltered find()[ns]"
+		  << "\tfind_batch()[ns]" << std::endl;
+	std::cout << at << "\t" << find << "\t" << filtered_find << "\t"
+		  << find_batch << std::endl;
+	std::cout << "filter: " << filtered.filter_size() << " bytes, "
+		  << filtered.filtered_count() << " misses answered, "
+		  << filtered.false_positive_count() << " false positives"
+		  << std::endl;
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * numa_topology.hpp -- NUMA nodes, their CPUs and the node of pmem pages,
+ * all read from sysfs and the kernel, without libnuma.
+ *
+ * Reads from pmem on another socket cost much more than local ones, more
+ * so than for DRAM, so threads scanning a pool should run on the node its
+ * pages are on. The node of a pool is the node of its pmem device
+ * (/sys/dev/block/M:m/device/numa_node); the node of single pages is asked
+ * for with move_pages(2), which may not know DAX pages, in which case the
+ * device's node is used. On a machine with one node (or without sysfs)
+ * nodes() is 1 and nothing needs to be pinned.
+ */
+
+#ifndef NUMA_TOPOLOGY_HPP
+#define NUMA_TOPOLOGY_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <vector>
+
+namespace examples
+{
+
+class numa_topology {
+public:
+	struct node {
+		int id;
+		std::vector<int> cpus;
+		/* distance to every other node, indexed like nodes */
+		std::vector<int> distance;
+	};
+
+	static numa_topology
+	detect()
+	{
+		numa_topology topo;
+		const std::string sys = "/sys/devices/system/node/";
+
+		std::string online;
+		if (read_line(sys + "online", online)) {
+			for (auto id : parse_list(online)) {
+				node n;
+				n.id = id;
+
+				std::string line;
+				auto dir =
+					sys + "node" + std::to_string(id) + "/";
+				if (read_line(dir + "cpulist", line))
+					n.cpus = parse_list(line);
+				if (read_line(dir + "distance", line)) {
+					std::istringstream is(line);
+					int d;
+					while (is >> d)
+						n.distance.push_back(d);
+				}
+
+				topo.all.push_back(n);
+			}
+		}
+
+		/* no sysfs: a single node with all CPUs */
+		if (topo.all.empty()) {
+			node n;
+			n.id = 0;
+			auto ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+			for (long cpu = 0; cpu < ncpus; cpu++)
+				n.cpus.push_back(cpu);
+			topo.all.push_back(n);
+		}
+
+		return topo;
+	}
+
+	std::size_t
+	nodes() const
+	{
+		return all.size();
+	}
+
+	/* returns nullptr for unknown ids */
+	const node *
+	find(int id) const
+	{
+		for (const auto &n : all)
+			if (n.id == id)
+				return &n;
+		return nullptr;
+	}
+
+	/* nodes which have CPUs, e.g. not the ones of pmem used as memory */
+	std::vector<int>
+	cpu_nodes() const
+	{
+		std::vector<int> ids;
+		for (const auto &n : all)
+			if (!n.cpus.empty())
+				ids.push_back(n.id);
+		return ids;
+	}
+
+	/*
+	 * Returns the node with CPUs closest to the given one (the node itself
+	 * if it has any) or -1 if the node is unknown.
+	 */
+	int
+	nearest_cpu_node(int id) const
+	{
+		auto n = find(id);
+		if (n == nullptr)
+			return -1;
+		if (!n->cpus.empty())
+			return id;
+
+		int best = -1;
+		int best_distance = std::numeric_limits<int>::max();
+		for (std::size_t i = 0; i < all.size(); i++) {
+			if (all[i].cpus.empty() || i >= n->distance.size())
+				continue;
+			if (n->distance[i] < best_distance) {
+				best = all[i].id;
+				best_distance = n->distance[i];
+			}
+		}
+
+		return best;
+	}
+
+	/* node of the device holding the file, -1 if unknown */
+	static int
+	node_of_file(const std::string &path)
+	{
+		struct stat st;
+		if (stat(path.c_str(), &st))
+			return -1;
+
+		/* devdax is a character device, fsdax a file on a block one */
+		std::string dev;
+		if (S_ISCHR(st.st_mode))
+			dev = "/sys/dev/char/" + dev_name(st.st_rdev);
+		else
+			dev = "/sys/dev/block/" + dev_name(st.st_dev);
+
+		/* a partition has no device, its parent does */
+		std::string line;
+		if (read_line(dev + "/device/numa_node", line) ||
+		    read_line(dev + "/../device/numa_node", line))
+			return std::stoi(line);
+
+		return -1;
+	}
+
+	/*
+	 * Fills nodes with the node of the page of every address, -1 where
+	 * the kernel does not know it.
+	 */
+	static void
+	page_nodes(const std::vector<const void *> &addrs,
+		   std::vector<int> &nodes)
+	{
+		nodes.assign(addrs.size(), -1);
+		if (addrs.empty())
+			return;
+
+		/* with no target nodes move_pages() only reports the status */
+		if (syscall(SYS_move_pages, 0, addrs.size(), addrs.data(),
+			    nullptr, nodes.data(), 0) != 0)
+			std::fill(nodes.begin(), nodes.end(), -1);
+
+		for (auto &n : nodes)
+			if (n < 0)
+				n = -1;
+	}
+
+	/* restricts the calling thread to the CPUs of the node */
+	bool
+	pin(int id) const
+	{
+		auto n = find(id);
+		if (n == nullptr || n->cpus.empty())
+			return false;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (auto cpu : n->cpus)
+			if (cpu < CPU_SETSIZE)
+				CPU_SET(cpu, &set);
+
+		return pthread_setaffinity_np(pthread_self(), sizeof(set),
+					      &set) == 0;
+	}
+
+private:
+	static bool
+	read_line(const std::string &path, std::string &line)
+	{
+		std::ifstream f(path);
+		return std::getline(f, line) && !line.empty();
+	}
+
+	static std::string
+	dev_name(dev_t dev)
+	{
+		return std::to_string(major(dev)) + ":" +
+			std::to_string(minor(dev));
+	}
+
+	/* parses lists like "0-3,8-11" */
+	static std::vector<int>
+	parse_list(const std::string &list)
+	{
+		std::vector<int> ids;
+		std::istringstream is(list);
+		std::string range;
+
+		while (std::getline(is, range, ',')) {
+			auto dash = range.find('-');
+			int first = std::stoi(range.substr(0, dash));
+			int last = dash == std::string::npos
+				? first
+				: std::stoi(range.substr(dash + 1));
+			for (int id = first; id <= last; id++)
+				ids.push_back(id);
+		}
+
+		return ids;
+	}
+
+	std::vector<node> all;
+};
+
+} /* namespace examples */
+
+#endif /* NUMA_TOPOLOGY_HPP */
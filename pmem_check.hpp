@@ -0,0 +1,699 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * pmem_check.hpp -- lightweight checker of common persistent memory
+ * programming errors, a much faster (but less complete) alternative to
+ * running a program under valgrind --tool=pmemcheck.
+ *
+ * The checker provides drop-in replacements of p<>, persistent_ptr<>,
+ * experimental::vector<>, make_persistent(), pool<> and transaction which
+ * record the stores done through their write accessors:
+ *	- assignments to p<> and persistent_ptr<>, non-const vector accesses
+ *	  and allocations inside a transaction are snapshotted (or new), so
+ *	  their ranges are known to be safe to modify,
+ *	- an object dereferenced through persistent_ptr<> inside a transaction
+ *	  is taken as written, unless it was only used to reach one of the
+ *	  checked members above (e.g. r->obj->field = 1 for a p<> field),
+ *	- p<> assignments and non-const vector accesses outside of a
+ *	  transaction are stores which have to be persisted.
+ *
+ * The following is reported:
+ *	- an object written through a pointer in a transaction without a
+ *	  snapshot, e.g. a field which is not wrapped in p<>,
+ *	- a store outside of a transaction which was not persisted before the
+ *	  next transaction or pool close, e.g. a vector element reference
+ *	  obtained before a transaction and written in it,
+ *	- persistent_ptr<> assigned outside of a transaction, which is not
+ *	  failure atomic with the allocation and leaks the previous object.
+ *
+ * Stores are seen when the accessor is called, whatever value is written
+ * (a write through a raw reference is attributed to the accessor which
+ * handed it out). The state of the checker is kept per thread, without
+ * locking, and only holds what was accessed since the last transaction
+ * or checkpoint, so its cost does not grow with the size of the pool.
+ *
+ * Build with -DPMEM_CHECK and use the examples::check namespace instead of
+ * pmem::obj (see find_bugs.cpp).
+ */
+
+#ifndef PMEM_CHECK_HPP
+#define PMEM_CHECK_HPP
+
+#include <libpmemobj++/experimental/vector.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace examples
+{
+namespace check
+{
+
+using pmem::obj::delete_persistent;
+using pmem::obj::pool_base;
+
+class checker {
+public:
+	static checker &
+	instance()
+	{
+		static thread_local checker c;
+		return c;
+	}
+
+	/* memory which was snapshotted, allocated or is modified by the library */
+	void
+	snapshotted(const void *addr, std::size_t len)
+	{
+		if (in_tx())
+			add(covered, ptr(addr), len);
+	}
+
+	/*
+	 * a checked member at addr was accessed, so the object it is in was
+	 * dereferenced to reach it, not to be written directly
+	 */
+	void
+	member(const void *addr)
+	{
+		auto it = derefs.upper_bound(ptr(addr));
+		if (it == derefs.begin())
+			return;
+
+		--it;
+		if (ptr(addr) < it->first + it->second.len)
+			it->second.navigated = true;
+	}
+
+	/* object dereferenced through persistent_ptr<> */
+	void
+	deref(const void *addr, std::size_t len)
+	{
+		if (!in_tx() || addr == nullptr)
+			return;
+
+		auto &d = derefs[ptr(addr)];
+		d.len = std::max(d.len, len);
+	}
+
+	/* store through a p<> or a reference handed out by a vector */
+	void
+	store(const void *addr, std::size_t len, const char *what)
+	{
+		member(addr);
+
+		if (in_tx()) {
+			add(covered, ptr(addr), len);
+			return;
+		}
+
+		auto &s = unpersisted[ptr(addr)];
+		if (len >= s.first)
+			s = std::make_pair(len, what);
+	}
+
+	/* persistent_ptr<> assignment */
+	void
+	pointer_store(const void *addr, std::size_t len)
+	{
+		member(addr);
+
+		if (in_tx()) {
+			add(covered, ptr(addr), len);
+			return;
+		}
+
+		report("persistent_ptr assigned outside of a transaction"
+		       " (not failure atomic, previous object is leaked)",
+		       addr);
+	}
+
+	void
+	persisted(const void *addr, std::size_t len)
+	{
+		auto begin = ptr(addr);
+		auto end = begin + len;
+
+		auto it = unpersisted.lower_bound(begin);
+		while (it != unpersisted.end() && it->first < end) {
+			if (it->first + it->second.first <= end)
+				it = unpersisted.erase(it);
+			else
+				++it;
+		}
+	}
+
+	/* memory which is no longer valid, e.g. reallocated vector data */
+	void
+	forget(const void *addr, std::size_t len)
+	{
+		auto begin = ptr(addr);
+
+		auto it = unpersisted.lower_bound(begin);
+		while (it != unpersisted.end() && it->first < begin + len)
+			it = unpersisted.erase(it);
+	}
+
+	void
+	tx_begin()
+	{
+		checkpoint("before transaction #" +
+			   std::to_string(tx_count + 1));
+
+		tx_count++;
+		covered.clear();
+		derefs.clear();
+	}
+
+	/* has to be called before the transaction commits */
+	void
+	tx_end()
+	{
+		for (const auto &e : derefs) {
+			if (e.second.navigated)
+				continue;
+
+			auto end = find(covered, e.first);
+			if (end != nullptr && end >= e.first + e.second.len)
+				continue;
+
+			report("object dereferenced in transaction #" +
+				       std::to_string(tx_count) +
+				       " written without a snapshot",
+			       e.first);
+		}
+
+		covered.clear();
+		derefs.clear();
+	}
+
+	/* reports stores outside of transactions which were not persisted */
+	void
+	checkpoint(const std::string &where)
+	{
+		/* overlapping stores, e.g. of a vector and its element, once */
+		const char *reported_end = nullptr;
+
+		for (const auto &e : unpersisted) {
+			auto end = e.first + e.second.first;
+			if (reported_end != nullptr && e.first < reported_end) {
+				reported_end = std::max(reported_end, end);
+				continue;
+			}
+
+			report(std::string(e.second.second) +
+				       " modified outside of a transaction and"
+				       " not persisted " +
+				       where,
+			       e.first);
+			reported_end = end;
+		}
+
+		unpersisted.clear();
+	}
+
+	/* errors found by all threads */
+	std::size_t
+	errors() const
+	{
+		return nerrors();
+	}
+
+private:
+	struct deref_info {
+		std::size_t len = 0;
+		bool navigated = false;
+	};
+
+	/* disjoint byte ranges, end of each keyed by its beginning */
+	using range_map = std::map<const char *, const char *>;
+
+	static const char *
+	ptr(const void *addr)
+	{
+		return static_cast<const char *>(addr);
+	}
+
+	static bool
+	in_tx()
+	{
+		return pmemobj_tx_stage() == TX_STAGE_WORK;
+	}
+
+	static std::atomic<std::size_t> &
+	nerrors()
+	{
+		static std::atomic<std::size_t> n(0);
+		return n;
+	}
+
+	/* adds [addr, addr + len), merging it with the ranges it touches */
+	static void
+	add(range_map &ranges, const char *addr, std::size_t len)
+	{
+		auto begin = addr;
+		auto end = addr + len;
+
+		auto it = ranges.upper_bound(begin);
+		if (it != ranges.begin() && std::prev(it)->second >= begin)
+			--it;
+
+		while (it != ranges.end() && it->first <= end) {
+			begin = std::min(begin, it->first);
+			end = std::max(end, it->second);
+			it = ranges.erase(it);
+		}
+
+		ranges.emplace(begin, end);
+	}
+
+	/* returns the end of the range containing addr, or nullptr */
+	static const char *
+	find(const range_map &ranges, const char *addr)
+	{
+		auto it = ranges.upper_bound(addr);
+		if (it == ranges.begin())
+			return nullptr;
+
+		--it;
+		return addr < it->second ? it->second : nullptr;
+	}
+
+	static void
+	report(const std::string &msg, const void *addr)
+	{
+		nerrors()++;
+		std::cerr << "pmem_check: " << msg << " (" << addr << ")"
+			  << std::endl;
+	}
+
+	/* objects dereferenced in the current transaction */
+	std::map<const char *, deref_info> derefs;
+
+	/* stores outside of transactions not persisted yet, with their size */
+	std::map<const char *, std::pair<std::size_t, const char *>>
+		unpersisted;
+
+	range_map covered;
+	uint64_t tx_count = 0;
+};
+
+/* objects allocated in a transaction need no snapshot */
+template <typename T, typename... Args>
+pmem::obj::persistent_ptr<T>
+make_persistent(Args &&... args)
+{
+	auto ptr = pmem::obj::make_persistent<T>(std::forward<Args>(args)...);
+	checker::instance().snapshotted(ptr.get(), sizeof(T));
+	return ptr;
+}
+
+template <typename T>
+class p : public pmem::obj::p<T> {
+	using base = pmem::obj::p<T>;
+
+public:
+	p() = default;
+
+	p(const T &v) : base(v)
+	{
+	}
+
+	p &
+	operator=(const p &rhs)
+	{
+		return *this = rhs.get_ro();
+	}
+
+	p &
+	operator=(const T &v)
+	{
+		checker::instance().store(this, sizeof(*this), "p<> variable");
+		base::operator=(v);
+		return *this;
+	}
+
+	T &
+	get_rw()
+	{
+		checker::instance().store(this, sizeof(*this), "p<> variable");
+		return base::get_rw();
+	}
+
+	/*
+	 * The operators of pext.hpp modify the value through the base class,
+	 * these make them stores seen by the checker.
+	 */
+	p &
+	operator++()
+	{
+		return *this = this->get_ro() + 1;
+	}
+
+	p &
+	operator--()
+	{
+		return *this = this->get_ro() - 1;
+	}
+
+	T
+	operator++(int)
+	{
+		T v = this->get_ro();
+		*this = v + 1;
+		return v;
+	}
+
+	T
+	operator--(int)
+	{
+		T v = this->get_ro();
+		*this = v - 1;
+		return v;
+	}
+
+	template <typename Y>
+	p &
+	operator+=(const Y &rhs)
+	{
+		return *this = this->get_ro() + rhs;
+	}
+
+	template <typename Y>
+	p &
+	operator-=(const Y &rhs)
+	{
+		return *this = this->get_ro() - rhs;
+	}
+
+	template <typename Y>
+	p &
+	operator*=(const Y &rhs)
+	{
+		return *this = this->get_ro() * rhs;
+	}
+
+	template <typename Y>
+	p &
+	operator/=(const Y &rhs)
+	{
+		return *this = this->get_ro() / rhs;
+	}
+
+	template <typename Y>
+	p &
+	operator%=(const Y &rhs)
+	{
+		return *this = this->get_ro() % rhs;
+	}
+
+	template <typename Y>
+	p &
+	operator&=(const Y &rhs)
+	{
+		return *this = this->get_ro() & rhs;
+	}
+
+	template <typename Y>
+	p &
+	operator|=(const Y &rhs)
+	{
+		return *this = this->get_ro() | rhs;
+	}
+
+	template <typename Y>
+	p &
+	operator^=(const Y &rhs)
+	{
+		return *this = this->get_ro() ^ rhs;
+	}
+
+	template <typename Y>
+	p &
+	operator<<=(const Y &rhs)
+	{
+		return *this = this->get_ro() << rhs;
+	}
+
+	template <typename Y>
+	p &
+	operator>>=(const Y &rhs)
+	{
+		return *this = this->get_ro() >> rhs;
+	}
+};
+
+template <typename T>
+class persistent_ptr : public pmem::obj::persistent_ptr<T> {
+	using base = pmem::obj::persistent_ptr<T>;
+	using element_type = typename base::element_type;
+
+public:
+	persistent_ptr() = default;
+
+	persistent_ptr(std::nullptr_t) : base(nullptr)
+	{
+	}
+
+	persistent_ptr(const base &rhs) : base(rhs)
+	{
+	}
+
+	persistent_ptr &
+	operator=(const persistent_ptr &rhs)
+	{
+		return *this = static_cast<const base &>(rhs);
+	}
+
+	persistent_ptr &
+	operator=(const base &rhs)
+	{
+		checker::instance().pointer_store(this, sizeof(*this));
+		base::operator=(rhs);
+		return *this;
+	}
+
+	persistent_ptr &
+	operator=(std::nullptr_t)
+	{
+		return *this = base(nullptr);
+	}
+
+	element_type *
+	operator->() const
+	{
+		deref();
+		return this->get();
+	}
+
+	element_type &
+	operator*() const
+	{
+		deref();
+		return *this->get();
+	}
+
+private:
+	void
+	deref() const
+	{
+		auto &c = checker::instance();
+		c.member(this);
+		c.deref(this->get(), sizeof(element_type));
+	}
+};
+
+namespace experimental
+{
+
+template <typename T>
+class vector : public pmem::obj::experimental::vector<T> {
+	using base = pmem::obj::experimental::vector<T>;
+
+public:
+	using base::base;
+
+	T &
+	operator[](std::size_t n)
+	{
+		access(&base::operator[](n), 1, "vector element");
+		return base::operator[](n);
+	}
+
+	typename base::iterator
+	begin()
+	{
+		access(this->cdata(), this->size(), "vector data");
+		return base::begin();
+	}
+
+	void
+	push_back(const T &v)
+	{
+		modify([&] { base::push_back(v); });
+	}
+
+	template <typename... Args>
+	void
+	emplace_back(Args &&... args)
+	{
+		modify([&] { base::emplace_back(std::forward<Args>(args)...); });
+	}
+
+	void
+	resize(std::size_t n)
+	{
+		modify([&] { base::resize(n); });
+	}
+
+	void
+	reserve(std::size_t n)
+	{
+		modify([&] { base::reserve(n); });
+	}
+
+private:
+	/*
+	 * Non-const accessors hand out references which may be written, so
+	 * they count as stores: snapshotted by the library in a transaction,
+	 * to be persisted outside of it (use const accessors for reading).
+	 */
+	void
+	access(const T *elems, std::size_t n, const char *what)
+	{
+		auto &c = checker::instance();
+
+		c.member(this);
+		if (n != 0)
+			c.store(elems, n * sizeof(T), what);
+	}
+
+	/* modifiers run in (their own) transaction and may reallocate */
+	void
+	modify(std::function<void()> f)
+	{
+		auto &c = checker::instance();
+		auto data = this->cdata();
+		auto capacity = this->capacity();
+
+		c.member(this);
+		c.snapshotted(this, sizeof(*this));
+		f();
+
+		if (this->cdata() != data)
+			c.forget(data, capacity * sizeof(T));
+		c.persisted(this, sizeof(*this));
+	}
+};
+
+} /* namespace experimental */
+
+template <typename T>
+class pool : public pmem::obj::pool<T> {
+	using base = pmem::obj::pool<T>;
+
+public:
+	pool(const base &pop) : base(pop)
+	{
+	}
+
+	static pool
+	open(const std::string &path, const std::string &layout)
+	{
+		return pool(base::open(path, layout));
+	}
+
+	void
+	persist(const void *addr, std::size_t len)
+	{
+		base::persist(addr, len);
+		checker::instance().persisted(addr, len);
+	}
+
+	template <typename Y>
+	void
+	persist(const pmem::obj::p<Y> &prop)
+	{
+		persist(&prop, sizeof(prop));
+	}
+
+	template <typename Y>
+	void
+	persist(const pmem::obj::persistent_ptr<Y> &ptr)
+	{
+		persist(&ptr, sizeof(ptr));
+	}
+
+	void
+	close()
+	{
+		checker::instance().checkpoint("before pool close");
+		base::close();
+
+		auto n = checker::instance().errors();
+		std::cerr << "pmem_check: " << n << " error(s) found"
+			  << std::endl;
+	}
+};
+
+struct transaction {
+	static void
+	run(pool_base &pop, std::function<void()> tx)
+	{
+		auto &c = checker::instance();
+
+		c.tx_begin();
+		pmem::obj::transaction::run(pop, [&] {
+			tx();
+			c.tx_end();
+		});
+	}
+};
+
+} /* namespace check */
+} /* namespace examples */
+
+#endif /* PMEM_CHECK_HPP */
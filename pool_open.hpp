@@ -0,0 +1,292 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * pool_open.hpp -- opening pools so that the first requests after a restart
+ * do not pay for page faults.
+ *
+ * A freshly mapped pool has no page table entries, so the first touch of
+ * every page (a 1<<20 bucket table, a long queue) faults, which shows up as
+ * tail latency right after the program starts. open_pool() can fault the
+ * whole mapping in up front, split between several threads, advise the
+ * kernel to use huge pages, and report the page size the mapping actually
+ * got. The options are read from the environment:
+ *
+ *	POOL_PREFAULT=N		prefault the pool with N threads
+ *	POOL_HUGEPAGE=1		madvise(MADV_HUGEPAGE), warn if the mapping is
+ *				not 2M aligned
+ *	POOL_REPORT=1		print the mapping and its page sizes to stderr
+ *
+ * libpmemobj picks the address of the mapping itself (on DAX it aligns it
+ * to 2M when it can, PMEM_MMAP_HINT overrides it), so the alignment can
+ * only be checked here, not chosen.
+ */
+
+#ifndef POOL_OPEN_HPP
+#define POOL_OPEN_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <libpmemobj++/pool.hpp>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace examples
+{
+
+struct open_options {
+	/* number of threads faulting the pool in, 0 to skip it */
+	unsigned prefault_threads = 0;
+	bool hugepage = false;
+	bool report = false;
+
+	static open_options
+	from_env()
+	{
+		open_options opts;
+
+		if (auto s = std::getenv("POOL_PREFAULT"))
+			opts.prefault_threads = std::strtoul(s, nullptr, 10);
+		if (auto s = std::getenv("POOL_HUGEPAGE"))
+			opts.hugepage = std::string(s) != "0";
+		if (auto s = std::getenv("POOL_REPORT"))
+			opts.report = std::string(s) != "0";
+
+		return opts;
+	}
+};
+
+/* the mapping containing the pool, as seen in /proc/self/smaps */
+struct pool_mapping {
+	uintptr_t start = 0;
+	uintptr_t end = 0;
+	/* in bytes */
+	std::size_t kernel_page = 0;
+	std::size_t mmu_page = 0;
+	std::size_t pmd_mapped = 0;
+	std::size_t rss = 0;
+
+	static const std::size_t HUGE_PAGE = 2 << 20;
+
+	/* returns an empty mapping if addr was not found */
+	static pool_mapping
+	find(const void *addr)
+	{
+		auto a = reinterpret_cast<uintptr_t>(addr);
+		pool_mapping m;
+		bool found = false;
+
+		std::ifstream smaps("/proc/self/smaps");
+		std::string line;
+		while (std::getline(smaps, line)) {
+			unsigned long start, end;
+			char dash;
+			std::istringstream is(line);
+
+			/* a new mapping starts with its address range */
+			if (line.find(':') > line.find('-') &&
+			    is >> std::hex >> start >> dash >> end &&
+			    dash == '-') {
+				if (found)
+					break;
+				found = a >= start && a < end;
+				m.start = start;
+				m.end = end;
+				continue;
+			}
+
+			if (!found)
+				continue;
+
+			std::string key;
+			std::size_t kb;
+			if (!(is >> key >> kb))
+				continue;
+
+			if (key == "KernelPageSize:")
+				m.kernel_page = kb << 10;
+			else if (key == "MMUPageSize:")
+				m.mmu_page = kb << 10;
+			else if (key == "FilePmdMapped:")
+				m.pmd_mapped = kb << 10;
+			else if (key == "Rss:")
+				m.rss = kb << 10;
+		}
+
+		return found ? m : pool_mapping();
+	}
+
+	std::size_t
+	size() const
+	{
+		return end - start;
+	}
+
+	bool
+	aligned() const
+	{
+		return start % HUGE_PAGE == 0 && end % HUGE_PAGE == 0;
+	}
+
+	void
+	print(std::ostream &os) const
+	{
+		if (size() == 0) {
+			os << "pool mapping not found" << std::endl;
+			return;
+		}
+
+		os << "pool mapping: 0x" << std::hex << start << "-0x" << end
+		   << std::dec << " (" << (size() >> 20) << " MiB), "
+		   << (aligned() ? "" : "not ") << "2M aligned" << std::endl;
+		os << "page size: kernel " << (kernel_page >> 10) << " kB, mmu "
+		   << (mmu_page >> 10) << " kB, resident " << (rss >> 20)
+		   << " MiB, of which in 2M pages " << (pmd_mapped >> 20)
+		   << " MiB" << std::endl;
+	}
+};
+
+/*
+ * Touches every page of [addr, addr + len) with the given number of threads.
+ * The first byte of each page is written back with its own value, so the
+ * pages are mapped writable and the first store does not fault again. Has to be called
+ * before anything else uses the pool.
+ */
+inline void
+prefault(void *addr, std::size_t len, unsigned threads)
+{
+	auto base = static_cast<char *>(addr);
+	std::size_t page = sysconf(_SC_PAGESIZE);
+
+	/*
+	 * whole huge pages per thread, at least one, so none is faulted from
+	 * two threads
+	 */
+	std::size_t chunk = (len / std::max(threads, 1u) +
+			     pool_mapping::HUGE_PAGE - 1) /
+		pool_mapping::HUGE_PAGE * pool_mapping::HUGE_PAGE;
+	if (chunk == 0)
+		chunk = pool_mapping::HUGE_PAGE;
+
+	std::vector<std::thread> workers;
+	for (std::size_t off = 0; off < len; off += chunk) {
+		auto n = std::min(chunk, len - off);
+		workers.emplace_back([=] {
+			for (std::size_t i = 0; i < n; i += page) {
+				volatile char *c = base + off + i;
+				*c = *c;
+			}
+		});
+	}
+
+	for (auto &w : workers)
+		w.join();
+}
+
+/* prepares an already opened pool according to the options */
+inline void
+prepare_pool(PMEMobjpool *pop, const open_options &opts)
+{
+	if (!opts.prefault_threads && !opts.hugepage && !opts.report)
+		return;
+
+	auto m = pool_mapping::find(pop);
+	if (m.size() == 0) {
+		std::cerr << "pool mapping not found, not prefaulting"
+			  << std::endl;
+		return;
+	}
+
+	auto addr = reinterpret_cast<void *>(m.start);
+
+	if (opts.hugepage) {
+		if (madvise(addr, m.size(), MADV_HUGEPAGE))
+			perror("madvise");
+		if (!m.aligned())
+			std::cerr << "pool mapping is not 2M aligned, "
+				  << "set PMEM_MMAP_HINT to place it"
+				  << std::endl;
+	}
+
+	if (opts.prefault_threads) {
+		auto start = std::chrono::steady_clock::now();
+		prefault(addr, m.size(), opts.prefault_threads);
+		auto ms = std::chrono::duration_cast<
+			std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start);
+
+		if (opts.report)
+			std::cerr << "prefaulted with " << opts.prefault_threads
+				  << " threads in " << ms.count() << " ms"
+				  << std::endl;
+	}
+
+	if (opts.report)
+		pool_mapping::find(pop).print(std::cerr);
+}
+
+/* pool<T>::open() followed by prepare_pool() */
+template <typename T>
+pmem::obj::pool<T>
+open_pool(const std::string &path, const std::string &layout,
+	  const open_options &opts = open_options::from_env())
+{
+	auto pop = pmem::obj::pool<T>::open(path, layout);
+	prepare_pool(pop.handle(), opts);
+
+	return pop;
+}
+
+/* the same for pools of any layout */
+inline pmem::obj::pool_base
+open_pool_base(const std::string &path, const std::string &layout,
+	       const open_options &opts = open_options::from_env())
+{
+	auto pop = pmem::obj::pool_base::open(path, layout);
+	prepare_pool(pop.handle(), opts);
+
+	return pop;
+}
+
+} /* namespace examples */
+
+#endif /* POOL_OPEN_HPP */
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * pool_stats.cpp -- prints usage and fragmentation statistics of a pool
+ * created for any of the examples, e.g.:
+ *	./pool_stats simplekv-words word_count_v2
+ *	./pool_stats queue queue_v2
+ *
+ * For the word count pool it also prints how well the columns are packed.
+ */
+
+#include "pool_open.hpp"
+#include "pool_stats.hpp"
+#include "queue_pmemobj_cpp.hpp"
+#include "word_count.hpp"
+
+#include <iostream>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <utility>
+
+using pmem::obj::persistent_ptr;
+
+namespace ptl = pmem::obj::experimental;
+
+using column_type = examples::word_count::column_type;
+using simplekv_type = examples::word_count::kv_type;
+using journal_type = examples::word_count::journal_type;
+
+examples::type_names
+known_types()
+{
+	examples::type_names names;
+
+	names.add(0, "untyped (C API)");
+
+	names.add<examples::queue_node>("queue nodes");
+
+	names.add<simplekv_type>("simplekv");
+	names.add<std::pair<ptl::string, std::size_t>>("kv buckets");
+	names.add<persistent_ptr<column_type>>("kv values");
+	names.add<column_type>("columns");
+	names.add<column_type::segment>("column segment lists");
+	names.add<uint32_t>("column segments");
+	names.add<uint8_t>("packed column segments");
+	names.add<examples::word_dict::words_type>("dictionary");
+	names.add<ptl::string>("dictionary words");
+	names.add<char>("string data");
+	names.add<journal_type>("journal");
+	names.add<persistent_ptr<journal_type::entry_type>>("journal index");
+	names.add<journal_type::entry_type>("journal entries");
+
+	return names;
+}
+
+/* compression ratio of the word count columns */
+void
+print_columns(pmem::obj::pool_base &pop, std::ostream &os)
+{
+	pmem::obj::pool<examples::word_count::root> wc(pop);
+	auto r = wc.root();
+	if (r->journal == nullptr)
+		return;
+
+	uint64_t files = 0, packed = 0, ids = 0, stored = 0;
+	for (const auto &e : r->journal->all()) {
+		files++;
+		ids += e->data->size();
+		stored += e->data->stored_bytes();
+		packed += e->data->stored_bytes() <
+			e->data->size() * sizeof(uint32_t);
+	}
+
+	os << "columns: " << files << " (" << packed << " packed), " << ids
+	   << " ids, " << ids * sizeof(uint32_t) << " bytes raw, " << stored
+	   << " bytes stored";
+	if (stored != 0)
+		os << ", ratio " << double(ids * sizeof(uint32_t)) / stored;
+	os << std::endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		std::cerr << "usage: " << argv[0] << " file-name layout"
+			  << std::endl;
+		return 1;
+	}
+
+	auto pop = examples::open_pool_base(argv[1], argv[2]);
+
+	auto stats = examples::pool_stats::collect(pop, known_types());
+	stats.print(std::cout);
+
+	if (argv[2] == examples::word_count::LAYOUT)
+		print_columns(pop, std::cout);
+
+	pop.close();
+
+	return 0;
+}
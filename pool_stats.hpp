@@ -0,0 +1,263 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * pool_stats.hpp -- usage and fragmentation statistics of a pool.
+ *
+ * All objects of the pool are walked and grouped by their type number,
+ * which libpmemobj++ derives from the C++ type (pmem::detail::type_num),
+ * so types can be given readable names with type_names::add<T>(). Vectors
+ * and strings allocate their storage with the type number of the element.
+ *
+ * Free space is measured by reserving (and then cancelling) the largest
+ * possible blocks, down to MIN_PROBE bytes. Fragmentation is the part of
+ * that free space which is not available as a single block.
+ */
+
+#ifndef POOL_STATS_HPP
+#define POOL_STATS_HPP
+
+#include <libpmemobj.h>
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace examples
+{
+
+using pmem::obj::pool_base;
+
+class type_names {
+public:
+	template <typename T>
+	void
+	add(const std::string &name)
+	{
+		names[pmem::detail::type_num<T>()] = name;
+	}
+
+	void
+	add(uint64_t type_num, const std::string &name)
+	{
+		names[type_num] = name;
+	}
+
+	std::string
+	name(uint64_t type_num) const
+	{
+		auto it = names.find(type_num);
+		if (it != names.end())
+			return it->second;
+
+		return "type " + std::to_string(type_num);
+	}
+
+private:
+	std::map<uint64_t, std::string> names;
+};
+
+struct pool_stats {
+	/* smallest block probed when measuring free space */
+	static const std::size_t MIN_PROBE = 256 * 1024;
+
+	/* maximum number of blocks reserved when measuring free space */
+	static const std::size_t MAX_PROBES = 4096;
+
+	/* assumed size of an allocation header, if heap stats are off */
+	static const std::size_t HEADER_SIZE = 16;
+
+	struct type_stats {
+		uint64_t objects = 0;
+		uint64_t bytes = 0;
+	};
+
+	std::map<std::string, type_stats> types;
+
+	/* number of objects by usable size rounded up to a power of two */
+	std::map<uint64_t, uint64_t> size_classes;
+
+	uint64_t objects = 0;
+	uint64_t bytes = 0;
+
+	/* bytes taken from the heap, including headers and padding */
+	uint64_t allocated = 0;
+	bool allocated_estimated = false;
+
+	uint64_t free_bytes = 0;
+	uint64_t largest_free = 0;
+
+	static pool_stats
+	collect(pool_base &pop, const type_names &names = type_names())
+	{
+		pool_stats s;
+		auto handle = pop.handle();
+
+		for (auto oid = pmemobj_first(handle); !OID_IS_NULL(oid);
+		     oid = pmemobj_next(oid)) {
+			auto size = pmemobj_alloc_usable_size(oid);
+			auto &t = s.types[names.name(pmemobj_type_num(oid))];
+
+			t.objects++;
+			t.bytes += size;
+			s.objects++;
+			s.bytes += size;
+			s.size_classes[size_class(size)]++;
+		}
+
+		int enabled = 0;
+		if (pmemobj_ctl_get(handle, "stats.enabled", &enabled) == 0 &&
+		    enabled &&
+		    pmemobj_ctl_get(handle, "stats.heap.curr_allocated",
+				    &s.allocated) == 0) {
+			s.allocated_estimated = false;
+		} else {
+			s.allocated = s.bytes + s.objects * HEADER_SIZE;
+			s.allocated_estimated = true;
+		}
+
+		s.probe_free(handle);
+
+		return s;
+	}
+
+	/* part of the free space which is not in the largest block */
+	double
+	fragmentation() const
+	{
+		if (free_bytes == 0)
+			return 0;
+
+		return 1.0 - static_cast<double>(largest_free) / free_bytes;
+	}
+
+	void
+	print(std::ostream &os) const
+	{
+		os << "objects: " << objects << std::endl;
+		os << "live bytes: " << bytes << std::endl;
+		os << "allocated bytes: " << allocated
+		   << (allocated_estimated ? " (estimated)" : "") << std::endl;
+		os << "header and padding bytes: " << allocated - bytes
+		   << std::endl;
+		os << "free bytes (in blocks >= " << MIN_PROBE
+		   << "): " << free_bytes << std::endl;
+		os << "largest free block: " << largest_free << std::endl;
+		os << "fragmentation: " << std::fixed << std::setprecision(2)
+		   << fragmentation() * 100 << "%" << std::endl;
+
+		os << std::endl << "by type:" << std::endl;
+		for (const auto &t : types)
+			os << "  " << t.first << ": " << t.second.objects
+			   << " objects, " << t.second.bytes << " bytes"
+			   << std::endl;
+
+		os << std::endl << "by size:" << std::endl;
+		for (const auto &c : size_classes)
+			os << "  <= " << c.first << ": " << c.second
+			   << std::endl;
+	}
+
+private:
+	static uint64_t
+	size_class(uint64_t size)
+	{
+		uint64_t c = 1;
+		while (c < size)
+			c <<= 1;
+
+		return c;
+	}
+
+	/* largest size in [MIN_PROBE, max] which can be reserved, or 0 */
+	static uint64_t
+	largest_block(PMEMobjpool *pop, uint64_t max)
+	{
+		uint64_t lo = 0;
+		uint64_t hi = max;
+
+		while (hi - lo >= MIN_PROBE) {
+			auto size = lo + (hi - lo) / 2;
+			if (size < MIN_PROBE)
+				size = MIN_PROBE;
+
+			pobj_action act;
+			auto oid = pmemobj_reserve(pop, &act, size, 0);
+			if (OID_IS_NULL(oid)) {
+				hi = size - 1;
+			} else {
+				pmemobj_cancel(pop, &act, 1);
+				lo = size;
+			}
+		}
+
+		return lo;
+	}
+
+	/* reserves the largest blocks until none is left, then cancels */
+	void
+	probe_free(PMEMobjpool *pop)
+	{
+		std::vector<pobj_action> acts;
+		uint64_t max = PMEMOBJ_MAX_ALLOC_SIZE;
+
+		while (acts.size() < MAX_PROBES) {
+			auto size = largest_block(pop, max);
+			if (size == 0)
+				break;
+
+			acts.emplace_back();
+			auto oid = pmemobj_reserve(pop, &acts.back(), size, 0);
+			if (OID_IS_NULL(oid)) {
+				acts.pop_back();
+				break;
+			}
+
+			if (largest_free == 0)
+				largest_free = size;
+			free_bytes += size;
+			max = size;
+		}
+
+		if (!acts.empty())
+			pmemobj_cancel(pop, acts.data(), acts.size());
+	}
+};
+
+} /* namespace examples */
+
+#endif /* POOL_STATS_HPP */
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * priority_queue.hpp -- persistent priority queue of ints with delayed
+ * delivery.
+ *
+ * Elements live in two pairing heaps: the ready one, ordered by priority,
+ * and the delayed one, ordered by the time they become visible. Both push
+ * and meld are O(1), pop is O(log n) amortized. Every operation (including
+ * moving elements which became visible to the ready heap) is a single
+ * transaction, so the heaps are never seen reordered halfway.
+ */
+
+#ifndef PRIORITY_QUEUE_HPP
+#define PRIORITY_QUEUE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+namespace examples
+{
+
+using pmem::obj::delete_persistent;
+using pmem::obj::make_persistent;
+using pmem::obj::p;
+using pmem::obj::persistent_ptr;
+using pmem::obj::pool_base;
+using pmem::obj::transaction;
+
+struct priority_node {
+	p<int> value;
+	p<int64_t> prio;
+	p<int64_t> visible_at; /* milliseconds since the epoch */
+	p<uint64_t> seq;       /* keeps FIFO order of equal keys */
+
+	persistent_ptr<priority_node> child;
+	persistent_ptr<priority_node> sibling;
+};
+
+/**
+ * Key - member of the node the heap is ordered by
+ */
+template <p<int64_t> priority_node::*Key>
+class pairing_heap {
+public:
+	using node_ptr = persistent_ptr<priority_node>;
+
+	bool
+	empty() const
+	{
+		return root == nullptr;
+	}
+
+	uint64_t
+	size() const
+	{
+		return count;
+	}
+
+	node_ptr
+	top() const
+	{
+		return root;
+	}
+
+	/* has to be called in a transaction */
+	void
+	push(node_ptr node)
+	{
+		node->child = nullptr;
+		node->sibling = nullptr;
+		root = meld(root, node);
+		count = count + 1;
+	}
+
+	/* detaches the top node, has to be called in a transaction */
+	node_ptr
+	pop()
+	{
+		auto node = root;
+		root = merge_pairs(node->child);
+		node->child = nullptr;
+		count = count - 1;
+
+		return node;
+	}
+
+	/* calls f for every node, in no particular order */
+	template <typename F>
+	void
+	for_each(F f) const
+	{
+		std::vector<node_ptr> stack;
+		if (root != nullptr)
+			stack.push_back(root);
+
+		while (!stack.empty()) {
+			auto node = stack.back();
+			stack.pop_back();
+			f(*node);
+
+			if (node->sibling != nullptr)
+				stack.push_back(node->sibling);
+			if (node->child != nullptr)
+				stack.push_back(node->child);
+		}
+	}
+
+private:
+	static bool
+	less(const node_ptr &a, const node_ptr &b)
+	{
+		const priority_node &x = *a;
+		const priority_node &y = *b;
+
+		if ((x.*Key) != (y.*Key))
+			return (x.*Key) < (y.*Key);
+
+		return x.seq < y.seq;
+	}
+
+	static node_ptr
+	meld(node_ptr a, node_ptr b)
+	{
+		if (a == nullptr)
+			return b;
+		if (b == nullptr)
+			return a;
+		if (less(b, a))
+			std::swap(a, b);
+
+		b->sibling = a->child;
+		a->child = b;
+
+		return a;
+	}
+
+	/* standard two-pass merge, iterative to bound the stack */
+	static node_ptr
+	merge_pairs(node_ptr first)
+	{
+		std::vector<node_ptr> pairs;
+
+		while (first != nullptr) {
+			auto a = first;
+			auto b = a->sibling;
+
+			if (b == nullptr) {
+				pairs.push_back(a);
+				break;
+			}
+
+			first = b->sibling;
+			a->sibling = nullptr;
+			b->sibling = nullptr;
+			pairs.push_back(meld(a, b));
+		}
+
+		node_ptr root = nullptr;
+		for (auto it = pairs.rbegin(); it != pairs.rend(); ++it)
+			root = meld(*it, root);
+
+		return root;
+	}
+
+	node_ptr root = nullptr;
+	p<uint64_t> count = 0;
+};
+
+class priority_queue {
+public:
+	/* milliseconds since the epoch, survives restarts */
+	static int64_t
+	now()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			       std::chrono::system_clock::now()
+				       .time_since_epoch())
+			.count();
+	}
+
+	/* lower prio is served first; the value is invisible for delay ms */
+	void
+	push(pool_base &pop, int value, int64_t prio = 0, int64_t delay = 0)
+	{
+		transaction::run(pop, [&] {
+			auto node = make_persistent<priority_node>();
+			node->value = value;
+			node->prio = prio;
+			node->visible_at = now() + delay;
+			node->seq = next_seq;
+			next_seq = next_seq + 1;
+
+			if (delay > 0)
+				delayed.push(node);
+			else
+				ready.push(node);
+		});
+	}
+
+	/* throws std::out_of_range if no element is visible yet */
+	int
+	pop(pool_base &pop)
+	{
+		int value;
+		transaction::run(pop, [&] {
+			promote(now());
+
+			if (ready.empty())
+				throw std::out_of_range("no elements ready");
+
+			auto node = ready.pop();
+			value = node->value;
+			delete_persistent<priority_node>(node);
+		});
+
+		return value;
+	}
+
+	void
+	show()
+	{
+		auto t = now();
+
+		ready.for_each([&](const priority_node &n) {
+			std::cout << "show: " << n.value << " prio " << n.prio
+				  << std::endl;
+		});
+		delayed.for_each([&](const priority_node &n) {
+			std::cout << "show: " << n.value << " prio " << n.prio
+				  << " in " << n.visible_at - t << "ms"
+				  << std::endl;
+		});
+
+		std::cout << std::endl;
+	}
+
+	uint64_t
+	size() const
+	{
+		return ready.size() + delayed.size();
+	}
+
+	uint64_t
+	delayed_size() const
+	{
+		return delayed.size();
+	}
+
+private:
+	/* moves elements visible at time t to the ready heap */
+	void
+	promote(int64_t t)
+	{
+		while (!delayed.empty() && delayed.top()->visible_at <= t)
+			ready.push(delayed.pop());
+	}
+
+	pairing_heap<&priority_node::prio> ready;
+	pairing_heap<&priority_node::visible_at> delayed;
+	p<uint64_t> next_seq = 0;
+};
+
+} /* namespace examples */
+
+#endif /* PRIORITY_QUEUE_HPP */
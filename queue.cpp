@@ -39,10 +39,13 @@
 #include <iostream>
 #include <string>
 
+#include "latency_histogram.hpp"
+
 enum queue_op {
 	PUSH,
 	POP,
 	SHOW,
+	STATS,
 	EXIT,
 	MAX_OPS,
 };
@@ -67,6 +70,8 @@ struct queue {
 			tail->next = node;
 			tail = node;
 		}
+
+		count++;
 	}
 
 	// volatile version--> pmem version
@@ -85,6 +90,8 @@ struct queue {
 		if (head == nullptr)
 			tail = nullptr;
 
+		count--;
+
 		return value;
 	}
 
@@ -100,12 +107,19 @@ struct queue {
 		std::cout << std::endl;
 	}
 
+	std::size_t
+	size() const
+	{
+		return count;
+	}
+
 private:
 	queue_node *head = nullptr;
 	queue_node *tail = nullptr;
+	std::size_t count = 0;
 };
 
-const char *ops_str[MAX_OPS] = {"push", "pop", "show", "exit"};
+const char *ops_str[MAX_OPS] = {"push", "pop", "show", "stats", "exit"};
 
 queue_op
 parse_queue_ops(const std::string &ops)
@@ -125,9 +139,10 @@ main(int argc, char *argv[])
 	(void) path; // Use this to open a pool
 
 	queue q;
+	examples::latency_histogram push_latency, pop_latency;
 
 	while (1) {
-		std::cout << "[push value|pop|show|exit]" << std::endl;
+		std::cout << "[push value|pop|show|stats|exit]" << std::endl;
 
 		std::string command;
 		std::cin >> command;
@@ -140,18 +155,30 @@ main(int argc, char *argv[])
 				int value;
 				std::cin >> value;
 
+				auto start = examples::latency_histogram::clock::now();
 				q.push(value);
+				push_latency.record(start);
 
 				break;
 			}
 			case POP: {
-				std::cout << q.pop() << std::endl;
+				auto start = examples::latency_histogram::clock::now();
+				auto value = q.pop();
+				pop_latency.record(start);
+
+				std::cout << value << std::endl;
 				break;
 			}
 			case SHOW: {
 				q.show();
 				break;
 			}
+			case STATS: {
+				std::cout << "depth: " << q.size() << std::endl;
+				push_latency.print(std::cout, "push");
+				pop_latency.print(std::cout, "pop");
+				break;
+			}
 			case EXIT: {
 				exit(0);
 			}
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * queue_group.cpp -- drains a persistent queue with a group of consumers
+ * (queue_group.hpp), once with the elements spread round-robin over the
+ * consumers' shards and once with all of them pushed to a single shard,
+ * so they are distributed only by stealing.
+ *
+ * create the pool for this program using pmempool, for example:
+ *	pmempool create obj --layout=queue_group -s 1G queue_group
+ */
+
+#include "pool_open.hpp"
+#include "queue_group.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <libpmemobj++/pool.hpp>
+#include <thread>
+#include <vector>
+
+static const std::string LAYOUT = "queue_group";
+
+static const std::size_t MAX_CONSUMERS = 64;
+
+using group_type = examples::queue_group<int, MAX_CONSUMERS>;
+
+struct root {
+	group_type group;
+};
+
+/* pushes items to the shards chosen by shard_of, from nthreads threads */
+void
+fill(pmem::obj::pool<root> &pop, unsigned nthreads, int items,
+     std::size_t (*shard_of)(int item, unsigned nthreads))
+{
+	auto r = pop.root();
+	std::vector<std::thread> threads;
+
+	for (unsigned t = 0; t < nthreads; t++) {
+		threads.emplace_back([&, t] {
+			for (int i = t; i < items; i += nthreads)
+				r->group.push(pop, shard_of(i, nthreads), i);
+		});
+	}
+
+	for (auto &t : threads)
+		t.join();
+}
+
+/* drains the group with nthreads consumers, prints the throughput */
+bool
+drain(pmem::obj::pool<root> &pop, unsigned nthreads, int items)
+{
+	auto r = pop.root();
+	std::vector<std::thread> threads;
+	std::vector<uint64_t> popped(nthreads);
+	std::atomic<long long> sum(0);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned t = 0; t < nthreads; t++) {
+		threads.emplace_back([&, t] {
+			long long s = 0;
+			int value;
+			while (r->group.pop(pop, t, value)) {
+				s += value;
+				popped[t]++;
+			}
+			sum += s;
+		});
+	}
+
+	for (auto &t : threads)
+		t.join();
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	std::cout << "  " << items / elapsed.count() / 1000000
+		  << " Mops/s, popped per consumer:";
+	for (auto n : popped)
+		std::cout << " " << n;
+	std::cout << std::endl;
+
+	long long expected = (long long)items * (items - 1) / 2;
+	if (sum != expected || r->group.size() != 0) {
+		std::cerr << "elements lost or duplicated" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+std::size_t
+round_robin(int item, unsigned nthreads)
+{
+	return item % nthreads;
+}
+
+std::size_t
+single(int, unsigned)
+{
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [consumers [items]]" << std::endl;
+		return 1;
+	}
+
+	auto path = argv[1];
+	unsigned consumers = argc > 2
+		? std::strtoul(argv[2], nullptr, 10)
+		: std::max(1u, std::thread::hardware_concurrency());
+	int items = argc > 3 ? std::atoi(argv[3]) : 1000000;
+
+	if (consumers == 0 || consumers > MAX_CONSUMERS) {
+		std::cerr << "number of consumers has to be in 1.."
+			  << MAX_CONSUMERS << std::endl;
+		return 1;
+	}
+
+	auto pop = examples::open_pool<root>(path, LAYOUT);
+	bool ok = true;
+
+	std::cout << "round-robin:" << std::endl;
+	fill(pop, consumers, items, round_robin);
+	ok = ok && drain(pop, consumers, items);
+
+	std::cout << "single shard, stealing:" << std::endl;
+	fill(pop, consumers, items, single);
+	ok = ok && drain(pop, consumers, items);
+
+	pop.close();
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * queue_group.hpp -- persistent queue drained by a group of consumers.
+ *
+ * Every consumer owns a shard: a sub-queue with its own persistent mutex,
+ * so consumers don't contend on a single head. Producers pick the shard
+ * (round-robin or by hash). A consumer whose shard is empty steals a batch
+ * of elements from the fullest other shard; the nodes are relinked, not
+ * copied, in one transaction holding both locks, so after a crash every
+ * element is owned by exactly one shard.
+ */
+
+#ifndef QUEUE_GROUP_HPP
+#define QUEUE_GROUP_HPP
+
+#include "queue_pmemobj_cpp.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <libpmemobj++/mutex.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <mutex>
+
+namespace examples
+{
+
+using pmem::obj::pool_base;
+using pmem::obj::transaction;
+
+/**
+ * T - type of the elements
+ * Shards - maximum number of consumers
+ */
+template <typename T, std::size_t Shards = 64>
+class queue_group {
+public:
+	/* maximum number of elements stolen at once */
+	static const uint64_t STEAL_BATCH = 64;
+
+	void
+	push(pool_base &pop, std::size_t shard, const T &value)
+	{
+		auto &s = shards[shard % Shards];
+		transaction::run(pop, [&] { s.queue.push(pop, value); }, s.mtx);
+	}
+
+	/*
+	 * Pops an element from the consumer's shard, stealing from the others
+	 * if it's empty. Returns false if all shards are empty.
+	 */
+	bool
+	pop(pool_base &pop, std::size_t consumer, T &value)
+	{
+		auto &own = shards[consumer % Shards];
+
+		while (true) {
+			bool found = false;
+			transaction::run(pop, [&] {
+				if (own.queue.size() != 0) {
+					value = own.queue.pop(pop);
+					found = true;
+				}
+			}, own.mtx);
+
+			if (found)
+				return true;
+			if (!steal(pop, consumer))
+				return false;
+		}
+	}
+
+	/*
+	 * Moves up to half (and at most STEAL_BATCH) of the elements of the
+	 * fullest other shard to the consumer's shard. Returns false if all
+	 * other shards looked empty.
+	 */
+	bool
+	steal(pool_base &pop, std::size_t consumer)
+	{
+		auto me = consumer % Shards;
+
+		/* counts are read one shard at a time, they are only a hint */
+		std::size_t victim = Shards;
+		uint64_t most = 0;
+		for (std::size_t i = 0; i < Shards; i++) {
+			if (i == me)
+				continue;
+
+			auto n = depth(shards[i]);
+			if (n > most) {
+				victim = i;
+				most = n;
+			}
+		}
+
+		if (victim == Shards)
+			return false;
+
+		auto &own = shards[me];
+		auto &other = shards[victim];
+
+		/* locks are always taken in the order of shards */
+		auto &first = me < victim ? own : other;
+		auto &second = me < victim ? other : own;
+
+		transaction::run(pop, [&] {
+			auto n = std::min((other.queue.size() + 1) / 2,
+					  STEAL_BATCH);
+			own.queue.take(other.queue, n);
+		}, first.mtx, second.mtx);
+
+		return true;
+	}
+
+	uint64_t
+	size(std::size_t shard) const
+	{
+		return depth(shards[shard % Shards]);
+	}
+
+	uint64_t
+	size() const
+	{
+		uint64_t n = 0;
+		for (std::size_t i = 0; i < Shards; i++)
+			n += depth(shards[i]);
+
+		return n;
+	}
+
+private:
+	struct shard {
+		mutable pmem::obj::mutex mtx;
+		basic_queue<T> queue;
+	};
+
+	static uint64_t
+	depth(const shard &s)
+	{
+		std::unique_lock<pmem::obj::mutex> lock(s.mtx);
+		return s.queue.size();
+	}
+
+	shard shards[Shards];
+};
+
+template <typename T, std::size_t Shards>
+const uint64_t queue_group<T, Shards>::STEAL_BATCH;
+
+} /* namespace examples */
+
+#endif /* QUEUE_GROUP_HPP */
@@ -34,7 +34,7 @@
  * queue_pmemobj.cpp -- implementation of a persistent queue.
  *
  * create the pool for this program using pmempool, for example:
- *	pmempool create obj --layout=queue -s 1G queue_pool
+ *	pmempool create obj --layout=queue_v2 -s 1G queue_pool
  */
 
 #include <cstdio>
@@ -44,10 +44,14 @@
 
 #include <libpmemobj.h>
 
+#include "latency_histogram.hpp"
+#include "pool_open.hpp"
+
 enum queue_op {
 	PUSH,
 	POP,
 	SHOW,
+	STATS,
 	EXIT,
 	MAX_OPS,
 };
@@ -76,6 +80,9 @@ struct queue {
 				pmemobj_tx_add_range_direct(&tail, sizeof(tail));
 				tail = node;
 			}
+
+			pmemobj_tx_add_range_direct(&count, sizeof(count));
+			count++;
 		} TX_END;
 	}
 
@@ -98,6 +105,9 @@ struct queue {
 				pmemobj_tx_add_range_direct(&tail, sizeof(tail));
 				tail = OID_NULL;
 			}
+
+			pmemobj_tx_add_range_direct(&count, sizeof(count));
+			count--;
 		} TX_END;
 
 		return value;
@@ -117,12 +127,19 @@ struct queue {
 		std::cout << std::endl;
 	}
 
+	uint64_t
+	size() const
+	{
+		return count;
+	}
+
 private:
 	PMEMoid head;
 	PMEMoid tail;
+	uint64_t count;
 };
 
-const char *ops_str[MAX_OPS] = {"push", "pop", "show", "exit"};
+const char *ops_str[MAX_OPS] = {"push", "pop", "show", "stats", "exit"};
 
 queue_op
 parse_queue_ops(const std::string &ops)
@@ -144,15 +161,21 @@ main(int argc, char *argv[])
 	}
 
 	auto path = argv[1];
-	PMEMobjpool *pool = pmemobj_open(path, "queue");
+
+	/* the layout changes with the root, e.g. when count was added */
+	PMEMobjpool *pool = pmemobj_open(path, "queue_v2");
 	if (pool == NULL)
 		std::cerr << "failed to open the pool\n";
 
+	examples::prepare_pool(pool, examples::open_options::from_env());
+
 	PMEMoid root = pmemobj_root(pool, sizeof(struct queue));
 	struct queue *q = (struct queue*) pmemobj_direct(root);
 
+	examples::latency_histogram push_latency, pop_latency;
+
 	while (1) {
-		std::cout << "[push value|pop|show|exit]" << std::endl;
+		std::cout << "[push value|pop|show|stats|exit]" << std::endl;
 
 		std::string command;
 		std::cin >> command;
@@ -165,18 +188,30 @@ main(int argc, char *argv[])
 				int value;
 				std::cin >> value;
 
+				auto start = examples::latency_histogram::clock::now();
 				q->push(pool, value);
+				push_latency.record(start);
 
 				break;
 			}
 			case POP: {
-				std::cout << q->pop(pool) << std::endl;
+				auto start = examples::latency_histogram::clock::now();
+				auto value = q->pop(pool);
+				pop_latency.record(start);
+
+				std::cout << value << std::endl;
 				break;
 			}
 			case SHOW: {
 				q->show();
 				break;
 			}
+			case STATS: {
+				std::cout << "depth: " << q->size() << std::endl;
+				push_latency.print(std::cout, "push");
+				pop_latency.print(std::cout, "pop");
+				break;
+			}
 			case EXIT: {
 				pmemobj_close(pool);
 				exit(0);
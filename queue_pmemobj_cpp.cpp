@@ -34,7 +34,7 @@
  * queue_pmemobj_cpp.cpp -- implementation of a persistent queue.
  *
  * create the pool for this program using pmempool, for example:
- *	pmempool create obj --layout=queue -s 1G queue_pool
+ *	pmempool create obj --layout=queue_v2 -s 1G queue_pool
  */
 
 #include <cstdio>
@@ -42,82 +42,23 @@
 #include <iostream>
 #include <string>
 
-#include <libpmemobj++/make_persistent.hpp>
-#include <libpmemobj++/p.hpp>
-#include <libpmemobj++/persistent_ptr.hpp>
-#include <libpmemobj++/pool.hpp>
-#include <libpmemobj++/transaction.hpp>
+#include "latency_histogram.hpp"
+#include "pool_open.hpp"
+#include "queue_pmemobj_cpp.hpp"
 
 enum queue_op {
 	PUSH,
 	POP,
+	RESERVE,
+	ACK,
 	SHOW,
+	STATS,
 	EXIT,
 	MAX_OPS,
 };
 
-struct queue_node {
-	pmem::obj::p<int> value;
-	pmem::obj::persistent_ptr<queue_node> next;
-};
-
-struct queue {
-	void
-	push(pmem::obj::pool_base &pop, int value)
-	{
-		pmem::obj::transaction::run(pop, [&] {
-			auto node = pmem::obj::make_persistent<queue_node>();
-			node->value = value;
-			node->next = nullptr;
-
-			if (head == nullptr) {
-				head = tail = node;
-			} else {
-				tail->next = node;
-				tail = node;
-			}
-		});
-	}
-
-	int
-	pop(pmem::obj::pool_base &pop)
-	{
-		int value;
-		pmem::obj::transaction::run(pop, [&] {
-			if (head == nullptr)
-				throw std::out_of_range("no elements");
-
-			auto head_ptr = head;
-			value = head->value;
-
-			head = head->next;
-			pmem::obj::delete_persistent<queue_node>(head_ptr);
-
-			if (head == nullptr)
-				tail = nullptr;
-		});
-
-		return value;
-	}
-
-	void
-	show()
-	{
-		auto node = head;
-		while (node != nullptr) {
-			std::cout << "show: " << node->value << std::endl;
-			node = node->next;
-		}
-
-		std::cout << std::endl;
-	}
-
-private:
-	pmem::obj::persistent_ptr<queue_node> head = nullptr;
-	pmem::obj::persistent_ptr<queue_node> tail = nullptr;
-};
-
-const char *ops_str[MAX_OPS] = {"push", "pop", "show", "exit"};
+const char *ops_str[MAX_OPS] = {"push", "pop", "reserve", "ack",
+				   "show", "stats", "exit"};
 
 queue_op
 parse_queue_ops(const std::string &ops)
@@ -139,11 +80,18 @@ main(int argc, char *argv[])
 	}
 
 	auto path = argv[1];
-	auto pool = pmem::obj::pool<queue>::open(path, "queue");
+
+	/* the layout changes with the root, e.g. when count was added */
+	auto pool = examples::open_pool<examples::queue>(path, "queue_v2");
 	auto q = pool.root();
 
+	/* deliver again whatever was reserved, but not acknowledged */
+	q->recover(pool);
+
+	examples::latency_histogram push_latency, pop_latency;
+
 	while (1) {
-		std::cout << "[push value|pop|show|exit]" << std::endl;
+		std::cout << "[push value|pop|reserve n|ack node ticket|show|stats|exit]" << std::endl;
 
 		std::string command;
 		std::cin >> command;
@@ -156,18 +104,50 @@ main(int argc, char *argv[])
 				int value;
 				std::cin >> value;
 
+				auto start = examples::latency_histogram::clock::now();
 				q->push(pool, value);
+				push_latency.record(start);
 
 				break;
 			}
 			case POP: {
-				std::cout << q->pop(pool) << std::endl;
+				auto start = examples::latency_histogram::clock::now();
+				auto value = q->pop(pool);
+				pop_latency.record(start);
+
+				std::cout << value << std::endl;
+				break;
+			}
+			case RESERVE: {
+				uint64_t n;
+				std::cin >> n;
+
+				for (auto &item : q->reserve(pool, n))
+					std::cout << item.first.off << " "
+						  << item.first.ticket << " "
+						  << item.second << std::endl;
+				break;
+			}
+			case ACK: {
+				examples::queue::reservation_id id;
+				std::cin >> id.off >> id.ticket;
+
+				if (!q->ack(pool, id))
+					std::cout << "unknown id" << std::endl;
 				break;
 			}
 			case SHOW: {
 				q->show();
 				break;
 			}
+			case STATS: {
+				std::cout << "depth: " << q->size() << std::endl;
+				std::cout << "in flight: " << q->inflight_size()
+					  << std::endl;
+				push_latency.print(std::cout, "push");
+				pop_latency.print(std::cout, "pop");
+				break;
+			}
 			case EXIT: {
 				pool.close();
 				exit(0);
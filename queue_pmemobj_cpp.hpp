@@ -0,0 +1,572 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * queue_pmemobj_cpp.hpp -- persistent FIFO queue.
+ *
+ * basic_queue<T> stores values of a trivially copyable type T in the nodes,
+ * basic_queue<blob> stores variable-size messages inline in the node, after
+ * its length. Messages of at least LARGE_BLOB bytes are written outside of
+ * the transaction, with non-temporal stores, to a reserved node which is
+ * then published by the transaction linking it into the queue, so the
+ * message is not written twice (to the undo log and in place).
+ *
+ * Instead of pop(), elements of basic_queue<T> can be taken in batches with
+ * reserve(), which moves them to a persistent in-flight list, and
+ * acknowledged one by one with ack(), which only flips (and persists) an
+ * 8-byte flag. Acknowledged elements are freed by the next reserve(); the
+ * others are delivered again after recover(). An id handed out by reserve()
+ * is the offset of the node and a ticket from a persistent counter, which
+ * is stored in the node, so ack() finds the node directly and rejects ids
+ * of nodes which were acknowledged, requeued, or freed and reused.
+ */
+
+#ifndef QUEUE_PMEMOBJ_CPP_HPP
+#define QUEUE_PMEMOBJ_CPP_HPP
+
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <libpmemobj.h>
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/mutex.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+namespace examples
+{
+
+using pmem::obj::delete_persistent;
+using pmem::obj::make_persistent;
+using pmem::obj::p;
+using pmem::obj::persistent_ptr;
+using pmem::obj::pool_base;
+using pmem::obj::transaction;
+
+template <typename T>
+struct basic_queue_node {
+	p<T> value;
+	persistent_ptr<basic_queue_node> next;
+	p<uint64_t> acked;
+
+	/* id given out by reserve(), 0 while the node is queued */
+	p<uint64_t> ticket;
+};
+
+/* payload type of queues of variable-size messages */
+struct blob {
+};
+
+/* header of a message, its size bytes follow it in the same object */
+struct blob_node {
+	persistent_ptr<blob_node> next;
+	p<uint64_t> size;
+
+	char *
+	data()
+	{
+		return reinterpret_cast<char *>(this + 1);
+	}
+};
+
+/**
+ * Node - type of the nodes of the list, with a next pointer
+ */
+template <typename Node>
+class queue_list {
+public:
+	uint64_t
+	size() const
+	{
+		return count;
+	}
+
+	/* throws std::logic_error if head and tail (or count) do not agree */
+	void
+	check() const
+	{
+		if ((head == nullptr) != (tail == nullptr))
+			throw std::logic_error("only one of head and tail set");
+
+		uint64_t n = 0;
+		auto node = head;
+		while (node != nullptr && node != tail) {
+			node = node->next;
+			n++;
+		}
+
+		if (node != tail)
+			throw std::logic_error("tail not reachable from head");
+		if (n + (tail != nullptr) != count)
+			throw std::logic_error("count does not match elements");
+		if (tail != nullptr && tail->next != nullptr)
+			throw std::logic_error("tail is not the last node");
+	}
+
+	/*
+	 * Moves up to n nodes from the head of the other list to the tail of
+	 * this one, returns how many were moved. Has to be called in
+	 * a transaction.
+	 */
+	uint64_t
+	take(queue_list &from, uint64_t n)
+	{
+		if (n == 0 || from.head == nullptr)
+			return 0;
+
+		auto first = from.head;
+		auto last = first;
+		uint64_t moved = 1;
+		while (moved < n && last->next != nullptr) {
+			last = last->next;
+			moved++;
+		}
+
+		from.head = last->next;
+		if (from.head == nullptr)
+			from.tail = nullptr;
+		from.count = from.count - moved;
+
+		last->next = nullptr;
+		if (head == nullptr)
+			head = first;
+		else
+			tail->next = first;
+		tail = last;
+		count = count + moved;
+
+		return moved;
+	}
+
+	/*
+	 * Moves all nodes of the other list to the front of this one. Has to
+	 * be called in a transaction.
+	 */
+	void
+	requeue(queue_list &from)
+	{
+		if (from.head == nullptr)
+			return;
+
+		from.tail->next = head;
+		if (head == nullptr)
+			tail = from.tail;
+		head = from.head;
+		count = count + from.count;
+
+		from.head = from.tail = nullptr;
+		from.count = 0;
+	}
+
+	/* calls f(node) for every node, from head to tail */
+	template <typename F>
+	void
+	for_each_node(F f)
+	{
+		for (auto node = head; node != nullptr; node = node->next)
+			f(*node);
+	}
+
+	/*
+	 * Unlinks and frees nodes for which pred(node) is true, returns how
+	 * many. Has to be called in a transaction.
+	 */
+	template <typename Pred>
+	uint64_t
+	remove_if(Pred pred)
+	{
+		uint64_t removed = 0;
+		persistent_ptr<Node> prev = nullptr;
+		auto node = head;
+
+		while (node != nullptr) {
+			auto next = node->next;
+
+			if (!pred(*node)) {
+				prev = node;
+				node = next;
+				continue;
+			}
+
+			if (prev == nullptr)
+				head = next;
+			else
+				prev->next = next;
+			if (tail == node)
+				tail = prev;
+
+			delete_persistent<Node>(node);
+			removed++;
+			node = next;
+		}
+
+		count = count - removed;
+
+		return removed;
+	}
+
+protected:
+	/* appends the node, has to be called in a transaction */
+	void
+	link(persistent_ptr<Node> node)
+	{
+		if (head == nullptr) {
+			head = tail = node;
+		} else {
+			tail->next = node;
+			tail = node;
+		}
+
+		count = count + 1;
+	}
+
+	/* detaches the first node, has to be called in a transaction */
+	persistent_ptr<Node>
+	unlink()
+	{
+		if (head == nullptr)
+			throw std::out_of_range("no elements");
+
+		auto node = head;
+		head = head->next;
+
+		if (head == nullptr)
+			tail = nullptr;
+
+		count = count - 1;
+
+		return node;
+	}
+
+	persistent_ptr<Node> head = nullptr;
+	persistent_ptr<Node> tail = nullptr;
+
+	/* number of elements, so depth is known without walking the list */
+	p<uint64_t> count = 0;
+};
+
+template <typename T>
+struct basic_queue : public queue_list<basic_queue_node<T>> {
+	using node_type = basic_queue_node<T>;
+
+	/* identifies a reserved element: offset of its node and its ticket */
+	struct reservation_id {
+		uint64_t off;
+		uint64_t ticket;
+	};
+
+	void
+	push(pool_base &pop, const T &value)
+	{
+		transaction::run(pop, [&] {
+			auto node = make_persistent<node_type>();
+			node->value = value;
+			node->next = nullptr;
+			node->acked = 0;
+			node->ticket = 0;
+
+			this->link(node);
+		}, mtx);
+	}
+
+	T
+	pop(pool_base &pop)
+	{
+		T value;
+		transaction::run(pop, [&] {
+			auto node = this->unlink();
+			value = node->value;
+
+			delete_persistent<node_type>(node);
+		}, mtx);
+
+		return value;
+	}
+
+	/*
+	 * Moves up to n elements to the in-flight list and returns them with
+	 * their ids, in a single transaction. Every id has to be passed to
+	 * ack() exactly once.
+	 */
+	std::vector<std::pair<reservation_id, T>>
+	reserve(pool_base &pop, uint64_t n)
+	{
+		std::vector<std::pair<reservation_id, T>> items;
+
+		transaction::run(pop, [&] {
+			reclaim();
+
+			auto node = this->head;
+			auto moved = inflight.take(*this, n);
+			for (; moved != 0; moved--, node = node->next) {
+				tickets = tickets + 1;
+				node->ticket = tickets;
+				items.emplace_back(
+					reservation_id{node.raw().off, tickets},
+					node->value);
+			}
+		}, mtx);
+
+		return items;
+	}
+
+	/*
+	 * Marks a reserved element as processed, without a transaction.
+	 * Returns false if id is not the id of an element in flight, e.g.
+	 * because it was already acknowledged. The id has to come from
+	 * reserve() on this queue, its offset is not validated otherwise.
+	 */
+	bool
+	ack(pool_base &pop, reservation_id id)
+	{
+		if (id.off == 0 || id.ticket == 0)
+			return false;
+
+		/* reserve() could free the node under us otherwise */
+		std::unique_lock<pmem::obj::mutex> lock(mtx);
+
+		auto oid = pmemobj_oid(this);
+		oid.off = id.off;
+
+		auto node = static_cast<node_type *>(pmemobj_direct(oid));
+		if (node->ticket != id.ticket || node->acked != 0)
+			return false;
+
+		node->acked = 1;
+		pop.persist(node->acked);
+
+		return true;
+	}
+
+	/*
+	 * Frees acknowledged elements and puts the rest of the in-flight ones
+	 * back at the front of the queue. Has to be called before the queue
+	 * is used after the pool is opened.
+	 */
+	void
+	recover(pool_base &pop)
+	{
+		transaction::run(pop, [&] {
+			reclaim();
+
+			/* ids of requeued elements are no longer valid */
+			inflight.for_each_node(
+				[](node_type &node) { node.ticket = 0; });
+			this->requeue(inflight);
+		}, mtx);
+	}
+
+	uint64_t
+	inflight_size() const
+	{
+		return inflight.size();
+	}
+
+	void
+	check() const
+	{
+		queue_list<node_type>::check();
+		inflight.check();
+	}
+
+	/* calls f for every value, from head to tail */
+	template <typename F>
+	void
+	for_each(F f) const
+	{
+		for (auto node = this->head; node != nullptr; node = node->next)
+			f(node->value.get_ro());
+	}
+
+	void
+	show()
+	{
+		auto node = this->head;
+		while (node != nullptr) {
+			std::cout << "show: " << node->value << std::endl;
+			node = node->next;
+		}
+
+		std::cout << std::endl;
+	}
+
+private:
+	/* has to be called in a transaction */
+	void
+	reclaim()
+	{
+		inflight.remove_if(
+			[](const node_type &node) { return node.acked != 0; });
+	}
+
+	/* reserved, but not yet acknowledged elements */
+	queue_list<node_type> inflight;
+
+	/* last id given out by reserve() */
+	p<uint64_t> tickets = 0;
+
+	/*
+	 * taken by every operation, so ack() cannot race with reclaim(); the
+	 * layout name of the pool (queue_v2) covers the in-flight list, the
+	 * tickets and this mutex as well
+	 */
+	pmem::obj::mutex mtx;
+};
+
+/*
+ * Unlike basic_queue<T>, this one has no mutex: it is meant to be used by
+ * a single thread at a time, and callers sharing it have to lock around it.
+ */
+template <>
+struct basic_queue<blob> : public queue_list<blob_node> {
+	/* size from which messages are written with non-temporal stores */
+	static const std::size_t LARGE_BLOB = 4096;
+
+	void
+	push(pool_base &pop, const void *data, std::size_t size)
+	{
+		if (size >= LARGE_BLOB) {
+			push_large(pop, data, size);
+			return;
+		}
+
+		transaction::run(pop, [&] {
+			auto oid = pmemobj_tx_alloc(sizeof(blob_node) + size,
+						    type_num());
+			if (OID_IS_NULL(oid))
+				throw pmem::transaction_alloc_error(
+					"failed to allocate a message");
+
+			persistent_ptr<blob_node> node(oid);
+
+			new (node.get()) blob_node();
+			node->size = size;
+			std::memcpy(node->data(), data, size);
+
+			link(node);
+		});
+	}
+
+	std::string
+	pop(pool_base &pop)
+	{
+		std::string value;
+		transaction::run(pop, [&] {
+			auto node = unlink();
+			value.assign(node->data(), node->size);
+
+			delete_persistent<blob_node>(node);
+		});
+
+		return value;
+	}
+
+	/* calls f(data, size) for every message, from head to tail */
+	template <typename F>
+	void
+	for_each(F f) const
+	{
+		for (auto node = head; node != nullptr; node = node->next)
+			f(static_cast<const char *>(node->data()),
+			  node->size.get_ro());
+	}
+
+	void
+	show()
+	{
+		for_each([](const char *data, uint64_t size) {
+			std::cout << "show: " << std::string(data, size)
+				  << std::endl;
+		});
+
+		std::cout << std::endl;
+	}
+
+private:
+	static uint64_t
+	type_num()
+	{
+		return pmem::detail::type_num<blob_node>();
+	}
+
+	void
+	push_large(pool_base &pop, const void *data, std::size_t size)
+	{
+		pobj_action act;
+		auto oid = pmemobj_reserve(pop.handle(), &act,
+					   sizeof(blob_node) + size, type_num());
+		if (OID_IS_NULL(oid))
+			throw std::bad_alloc();
+
+		persistent_ptr<blob_node> node(oid);
+		new (node.get()) blob_node();
+		node->size = size;
+		pop.persist(node.get(), sizeof(blob_node));
+		pmemobj_memcpy(pop.handle(), node->data(), data, size,
+			       PMEMOBJ_F_MEM_NONTEMPORAL);
+
+		bool published = false;
+		try {
+			transaction::run(pop, [&] {
+				link(node);
+
+				if (pmemobj_tx_publish(&act, 1) != 0)
+					throw std::runtime_error(
+						pmemobj_errormsg());
+				published = true;
+			});
+		} catch (...) {
+			/* once published the transaction cancels it */
+			if (!published)
+				pmemobj_cancel(pop.handle(), &act, 1);
+			throw;
+		}
+	}
+};
+
+using queue_node = basic_queue_node<int>;
+using queue = basic_queue<int>;
+using blob_queue = basic_queue<blob>;
+
+} /* namespace examples */
+
+#endif /* QUEUE_PMEMOBJ_CPP_HPP */
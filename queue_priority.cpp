@@ -0,0 +1,179 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * queue_priority.cpp -- persistent queue with priorities and delayed
+ * delivery, e.g.:
+ *	push 5			(priority 0, visible right away)
+ *	push 6 prio -1		(served before the ones with priority 0)
+ *	push 7 delay 1000	(not popped for the next second)
+ *	push 8 prio 2 delay 500
+ *
+ * create the pool for this program using pmempool, for example:
+ *	pmempool create obj --layout=queue_priority -s 1G queue_priority
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "latency_histogram.hpp"
+#include "pool_open.hpp"
+#include "priority_queue.hpp"
+
+enum queue_op {
+	PUSH,
+	POP,
+	SHOW,
+	STATS,
+	EXIT,
+	MAX_OPS,
+};
+
+const char *ops_str[MAX_OPS] = {"push", "pop", "show", "stats", "exit"};
+
+queue_op
+parse_queue_ops(const std::string &ops)
+{
+	for (int i = 0; i < MAX_OPS; i++) {
+		if (ops == ops_str[i]) {
+			return (queue_op)i;
+		}
+	}
+	return MAX_OPS;
+}
+
+/* parses "[prio P] [delay MS]", returns false on error */
+bool
+parse_push_options(const std::string &line, int64_t &prio, int64_t &delay)
+{
+	std::istringstream in(line);
+	std::string option;
+
+	while (in >> option) {
+		if (option == "prio" && in >> prio)
+			continue;
+		if (option == "delay" && in >> delay)
+			continue;
+
+		return false;
+	}
+
+	return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " pool" << std::endl;
+		return 1;
+	}
+
+	auto path = argv[1];
+	auto pool = examples::open_pool<examples::priority_queue>(
+		path, "queue_priority");
+	auto q = pool.root();
+
+	examples::latency_histogram push_latency, pop_latency;
+
+	while (1) {
+		std::cout << "[push value [prio P] [delay MS]|pop|show|stats|exit]"
+			  << std::endl;
+
+		std::string command;
+		std::cin >> command;
+
+		// parse string
+		auto ops = parse_queue_ops(std::string(command));
+
+		switch (ops) {
+			case PUSH: {
+				int value;
+				std::cin >> value;
+
+				std::string line;
+				std::getline(std::cin, line);
+
+				int64_t prio = 0, delay = 0;
+				if (!parse_push_options(line, prio, delay)) {
+					std::cerr << "invalid push options"
+						  << std::endl;
+					break;
+				}
+
+				auto start = examples::latency_histogram::clock::now();
+				q->push(pool, value, prio, delay);
+				push_latency.record(start);
+
+				break;
+			}
+			case POP: {
+				try {
+					auto start = examples::latency_histogram::clock::now();
+					auto value = q->pop(pool);
+					pop_latency.record(start);
+
+					std::cout << value << std::endl;
+				} catch (std::out_of_range &e) {
+					std::cout << e.what() << std::endl;
+				}
+				break;
+			}
+			case SHOW: {
+				q->show();
+				break;
+			}
+			case STATS: {
+				std::cout << "depth: " << q->size() << " ("
+					  << q->delayed_size() << " delayed)"
+					  << std::endl;
+				push_latency.print(std::cout, "push");
+				pop_latency.print(std::cout, "pop");
+				break;
+			}
+			case EXIT: {
+				pool.close();
+				exit(0);
+			}
+			default: {
+				std::cerr << "unknown ops" << std::endl;
+
+				pool.close();
+				exit(0);
+			}
+		}
+	}
+}
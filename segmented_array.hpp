@@ -0,0 +1,267 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * segmented_array.hpp -- persistent array of trivially copyable elements,
+ * appended in segments without undo logging of the data.
+ *
+ * Appending to a vector in a transaction snapshots the memory which is about
+ * to be written, so every byte ends up written twice. Here a segment is
+ * reserved and filled outside of a transaction, with non-temporal stores,
+ * and only then published by a small transaction (or redo log) which links
+ * it into the array. If the program crashes before that, the reservation is
+ * simply gone.
+ *
+ * A segment can also be stored packed by the array's Codec (see
+ * varint_codec.hpp), if that makes it smaller. for_each_run() decodes packed
+ * segments one at a time, as they are read.
+ */
+
+#ifndef SEGMENTED_ARRAY_HPP
+#define SEGMENTED_ARRAY_HPP
+
+#include <libpmemobj.h>
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/experimental/vector.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace examples
+{
+
+namespace ptl = pmem::obj::experimental;
+
+using pmem::obj::delete_persistent;
+using pmem::obj::p;
+using pmem::obj::persistent_ptr;
+using pmem::obj::pool_base;
+
+/* codec which never packs, segments are stored as they are */
+template <typename T>
+struct no_codec {
+	static bool
+	encode(const T *, std::size_t, std::vector<uint8_t> &)
+	{
+		return false;
+	}
+
+	static void
+	decode(const uint8_t *, std::size_t, T *, std::size_t)
+	{
+		throw std::logic_error("no_codec cannot decode");
+	}
+};
+
+/**
+ * Segment written outside of a transaction, waiting to be appended to
+ * an array. Cancelled if it's destroyed before being appended.
+ */
+template <typename T, typename Codec = no_codec<T>>
+class segment_reservation {
+public:
+	/* with pack, the data is stored encoded if that's smaller */
+	segment_reservation(pool_base &pop, const T *data, std::size_t n,
+			    bool pack = false)
+	    : pop(pop.handle()), oid(OID_NULL), n(n), bytes(n * sizeof(T))
+	{
+		/* there is nothing to append, so nothing to allocate */
+		if (n == 0)
+			return;
+
+		std::vector<uint8_t> packed;
+		const void *src = data;
+		auto type = pmem::detail::type_num<T>();
+
+		if (pack && Codec::encode(data, n, packed)) {
+			src = packed.data();
+			bytes = packed.size();
+			type = pmem::detail::type_num<uint8_t>();
+		}
+
+		oid = pmemobj_reserve(this->pop, &act, bytes, type);
+		if (OID_IS_NULL(oid))
+			throw std::bad_alloc();
+
+		pmemobj_memcpy(this->pop, pmemobj_direct(oid), src, bytes,
+			       PMEMOBJ_F_MEM_NONTEMPORAL);
+	}
+
+	segment_reservation(const segment_reservation &) = delete;
+	segment_reservation &operator=(const segment_reservation &) = delete;
+
+	~segment_reservation()
+	{
+		if (!published && !OID_IS_NULL(oid))
+			pmemobj_cancel(pop, &act, 1);
+	}
+
+private:
+	template <typename, typename>
+	friend class segmented_array;
+
+	PMEMobjpool *pop;
+	pobj_action act;
+	PMEMoid oid;
+	std::size_t n;
+	std::size_t bytes;
+	bool published = false;
+};
+
+template <typename T, typename Codec = no_codec<T>>
+class segmented_array {
+public:
+	static_assert(std::is_trivially_copyable<T>::value,
+		      "elements have to be trivially copyable");
+
+	using reservation = segment_reservation<T, Codec>;
+
+	struct segment {
+		segment(persistent_ptr<T[]> data, std::size_t size,
+			std::size_t bytes)
+		    : data(data), size(size), bytes(bytes)
+		{
+		}
+
+		/* stored encoded, data points to bytes, not to size T's */
+		bool
+		packed() const
+		{
+			return bytes < size * sizeof(T);
+		}
+
+		const uint8_t *
+		packed_data() const
+		{
+			return reinterpret_cast<const uint8_t *>(data.get());
+		}
+
+		persistent_ptr<T[]> data;
+		p<uint64_t> size;
+		p<uint64_t> bytes;
+	};
+
+	segmented_array() : total(0), stored(0)
+	{
+	}
+
+	/* appends the reserved segment, has to be called in a transaction */
+	void
+	append(reservation &res)
+	{
+		if (res.n == 0)
+			return;
+
+		segs.emplace_back(persistent_ptr<T[]>(res.oid), res.n,
+				  res.bytes);
+		total = total + res.n;
+		stored = stored + res.bytes;
+
+		if (pmemobj_tx_publish(&res.act, 1) != 0)
+			throw std::runtime_error(pmemobj_errormsg());
+		res.published = true;
+	}
+
+	/* frees all the segments, has to be called in a transaction */
+	void
+	clear()
+	{
+		for (auto &s : segs) {
+			if (s.packed())
+				delete_persistent<uint8_t[]>(
+					persistent_ptr<uint8_t[]>(s.data.raw()),
+					s.bytes);
+			else
+				delete_persistent<T[]>(s.data, s.size);
+		}
+
+		segs.clear();
+		total = 0;
+		stored = 0;
+	}
+
+	const ptl::vector<segment> &
+	segments() const
+	{
+		return segs;
+	}
+
+	/*
+	 * Calls f(data, n) for the elements of every segment, in order.
+	 * Packed segments are decoded into buf first, so data is valid only
+	 * until f returns.
+	 */
+	template <typename F>
+	void
+	for_each_run(std::vector<T> &buf, F f) const
+	{
+		for (const auto &s : segs) {
+			if (!s.packed()) {
+				f(s.data.get(), s.size);
+				continue;
+			}
+
+			buf.resize(s.size);
+			Codec::decode(s.packed_data(), s.bytes, buf.data(),
+				      s.size);
+			f(buf.data(), s.size);
+		}
+	}
+
+	uint64_t
+	size() const
+	{
+		return total;
+	}
+
+	/* bytes taken by the segments, less than size() T's if packed */
+	uint64_t
+	stored_bytes() const
+	{
+		return stored;
+	}
+
+private:
+	ptl::vector<segment> segs;
+	p<uint64_t> total;
+	p<uint64_t> stored;
+};
+
+} /* namespace examples */
+
+#endif /* SEGMENTED_ARRAY_HPP */
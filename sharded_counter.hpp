@@ -0,0 +1,152 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * sharded_counter.hpp -- persistent counter which scales with the number
+ * of threads incrementing it.
+ *
+ * Instead of a single variable updated in transactions, the counter is
+ * split into cache-line sized shards. Every thread increments its own shard
+ * with an 8-byte atomic operation followed by a flush, which is failure
+ * atomic without a transaction. The value is the sum of all shards.
+ */
+
+#ifndef SHARDED_COUNTER_HPP
+#define SHARDED_COUNTER_HPP
+
+#include <libpmemobj++/pool.hpp>
+#include <atomic>
+#include <cstdint>
+
+namespace examples
+{
+
+using pmem::obj::pool_base;
+
+/**
+ * Shards - number of shards, threads above that share them
+ */
+template <std::size_t Shards = 64>
+class sharded_counter {
+public:
+	static const std::size_t CACHELINE = 64;
+
+	/* adds n to the calling thread's shard and persists it */
+	void
+	add(pool_base &pop, uint64_t n = 1)
+	{
+		auto &v = shard(thread_shard());
+		v.fetch_add(n, std::memory_order_relaxed);
+		pop.persist(&v, sizeof(v));
+	}
+
+	uint64_t
+	get() const
+	{
+		uint64_t sum = 0;
+		for (std::size_t i = 0; i < Shards; i++)
+			sum += shard(i).load(std::memory_order_relaxed);
+
+		return sum;
+	}
+
+private:
+	static std::size_t
+	thread_shard()
+	{
+		static std::atomic<std::size_t> next{0};
+		static thread_local std::size_t index = next++ % Shards;
+
+		return index;
+	}
+
+	/* objects are not guaranteed to be cache line aligned in the pool */
+	std::atomic<uint64_t> &
+	shard(std::size_t i) const
+	{
+		auto base = reinterpret_cast<uintptr_t>(storage);
+		base = (base + CACHELINE - 1) & ~(uintptr_t)(CACHELINE - 1);
+
+		return *reinterpret_cast<std::atomic<uint64_t> *>(
+			base + i * CACHELINE);
+	}
+
+	char storage[(Shards + 1) * CACHELINE];
+};
+
+/**
+ * Volatile, per-thread front of a sharded_counter which combines up to
+ * batch increments before adding them to the counter. Increments which were
+ * not flushed yet are lost on a crash.
+ */
+template <typename Counter>
+class counter_combiner {
+public:
+	counter_combiner(pool_base &pop, Counter &counter, uint64_t batch)
+	    : pop(pop), counter(counter), batch(batch)
+	{
+	}
+
+	~counter_combiner()
+	{
+		flush();
+	}
+
+	void
+	add(uint64_t n = 1)
+	{
+		local += n;
+		if (local >= batch)
+			flush();
+	}
+
+	void
+	flush()
+	{
+		if (local == 0)
+			return;
+
+		counter.add(pop, local);
+		local = 0;
+	}
+
+private:
+	pool_base &pop;
+	Counter &counter;
+	uint64_t batch;
+	uint64_t local = 0;
+};
+
+} /* namespace examples */
+
+#endif /* SHARDED_COUNTER_HPP */
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * simplekv_cache.cpp -- persistent cache with expiring entries, bounded by
+ * bytes and evicted in the background (simplekv_cache.hpp), e.g.:
+ *	put a 1			(kept until evicted)
+ *	put b 2 ttl 5000	(expires in 5 seconds)
+ *	get a
+ *
+ * create the pool for this program using pmempool, for example:
+ *	pmempool create obj --layout=simplekv_cache -s 1G simplekv_cache
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "latency_histogram.hpp"
+#include "pool_open.hpp"
+#include "simplekv_cache.hpp"
+
+static const std::string LAYOUT = "simplekv_cache";
+
+/* default capacity of a new cache */
+static const uint64_t CAPACITY = 64 << 20;
+
+using cache_type = examples::cache<(1 << 16)>;
+
+struct root {
+	pmem::obj::persistent_ptr<cache_type> cache;
+};
+
+enum cache_op {
+	PUT,
+	GET,
+	ERASE,
+	STATS,
+	EXIT,
+	MAX_OPS,
+};
+
+const char *ops_str[MAX_OPS] = {"put", "get", "erase", "stats", "exit"};
+
+cache_op
+parse_cache_ops(const std::string &ops)
+{
+	for (int i = 0; i < MAX_OPS; i++) {
+		if (ops == ops_str[i]) {
+			return (cache_op)i;
+		}
+	}
+	return MAX_OPS;
+}
+
+/* parses "[ttl MS]", returns false on error */
+bool
+parse_put_options(const std::string &line, int64_t &ttl)
+{
+	std::istringstream in(line);
+	std::string option;
+
+	while (in >> option) {
+		if (option == "ttl" && in >> ttl)
+			continue;
+
+		return false;
+	}
+
+	return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " pool [capacity-bytes]"
+			  << std::endl;
+		return 1;
+	}
+
+	auto path = argv[1];
+	auto pool = examples::open_pool<root>(path, LAYOUT);
+	auto r = pool.root();
+
+	if (r->cache == nullptr) {
+		pmem::obj::transaction::run(pool, [&] {
+			r->cache = pmem::obj::make_persistent<cache_type>(
+				CAPACITY);
+		});
+	}
+
+	auto c = r->cache;
+	if (argc > 2)
+		c->set_capacity(std::strtoull(argv[2], nullptr, 10));
+
+	examples::cache_evictor<cache_type> evictor(*c);
+	examples::latency_histogram put_latency, get_latency;
+
+	while (1) {
+		std::cout << "[put key value [ttl MS]|get key|erase key|stats|exit]"
+			  << std::endl;
+
+		std::string command;
+		std::cin >> command;
+
+		// parse string
+		auto ops = parse_cache_ops(std::string(command));
+
+		switch (ops) {
+			case PUT: {
+				std::string key, value;
+				std::cin >> key >> value;
+
+				std::string line;
+				std::getline(std::cin, line);
+
+				int64_t ttl = 0;
+				if (!parse_put_options(line, ttl)) {
+					std::cerr << "invalid put options"
+						  << std::endl;
+					break;
+				}
+
+				auto start = examples::latency_histogram::clock::now();
+				c->put(key, value, ttl);
+				put_latency.record(start);
+
+				break;
+			}
+			case GET: {
+				std::string key, value;
+				std::cin >> key;
+
+				auto start = examples::latency_histogram::clock::now();
+				bool found = c->get(key, value);
+				get_latency.record(start);
+
+				if (found)
+					std::cout << value << std::endl;
+				else
+					std::cout << "no entry" << std::endl;
+				break;
+			}
+			case ERASE: {
+				std::string key;
+				std::cin >> key;
+
+				if (!c->erase(key))
+					std::cout << "no entry" << std::endl;
+				break;
+			}
+			case STATS: {
+				std::cout << "entries: " << c->size() << ", used "
+					  << c->used_bytes() << " of "
+					  << c->capacity_bytes() << " bytes"
+					  << std::endl;
+				put_latency.print(std::cout, "put");
+				get_latency.print(std::cout, "get");
+				break;
+			}
+			case EXIT: {
+				evictor.stop();
+				pool.close();
+				exit(0);
+			}
+			default: {
+				std::cerr << "unknown ops" << std::endl;
+
+				evictor.stop();
+				pool.close();
+				exit(0);
+			}
+		}
+	}
+}
@@ -0,0 +1,485 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * simplekv_cache.hpp -- persistent cache of strings on top of kv, which
+ * survives restarts warm.
+ *
+ * Entries can have a time to live and the cache is bounded by the bytes its
+ * entries take. They are kept in a circular list in insertion order and
+ * evicted with CLOCK: get() sets the entry's access bit (an atomic 8-byte
+ * store, persisted without a transaction, and only if it was clear), the hand
+ * clears the bits of the entries it passes and evicts the first one whose
+ * bit is clear. Expired entries are never returned and are freed whenever
+ * the hand passes them.
+ *
+ * Eviction runs in a background thread (cache_evictor), in transactions of
+ * a bounded number of steps, so lookups and inserts are not stalled for
+ * long; the access bits and the hand are persistent, so a restarted cache
+ * goes on evicting where it stopped. If the evictor falls behind by more
+ * than an eighth of the capacity, put() evicts as well. The evictor only
+ * sweeps the entries for expired ones while some entry has a time to live.
+ */
+
+#ifndef SIMPLEKV_CACHE_HPP
+#define SIMPLEKV_CACHE_HPP
+
+#include "simplekv_optimized.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/shared_mutex.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <libpmemobj++/utils.hpp>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace examples
+{
+
+/**
+ * N - number of buckets of the index
+ */
+template <std::size_t N>
+class cache {
+public:
+	/* number of entries looked at by a single eviction transaction */
+	static const std::size_t BATCH = 64;
+
+	struct entry {
+		entry(const std::string &key, const std::string &value,
+		      int64_t expires)
+		    : key(key), value(value), expires(expires), referenced(0)
+		{
+		}
+
+		/* bytes charged to the capacity */
+		uint64_t
+		bytes() const
+		{
+			return sizeof(entry) + key.size() + value.size();
+		}
+
+		ptl::string key;
+		ptl::string value;
+
+		/* milliseconds since the epoch, 0 if it never expires */
+		p<int64_t> expires;
+
+		/*
+		 * CLOCK access bit, set by get() under the shared lock and
+		 * cleared by evict() under the exclusive one
+		 */
+		std::atomic<uint64_t> referenced;
+
+		persistent_ptr<entry> prev;
+		persistent_ptr<entry> next;
+	};
+
+	/* milliseconds since the epoch, survives restarts */
+	static int64_t
+	now()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			       std::chrono::system_clock::now()
+				       .time_since_epoch())
+			.count();
+	}
+
+	cache(uint64_t capacity)
+	    : capacity(capacity), used(0), count(0), expiring(0)
+	{
+	}
+
+	/* returns false if there is no such key or it has expired */
+	bool
+	get(const std::string &key, std::string &value)
+	{
+		/* keeps compact() from moving the index's values under it */
+		shared_lock lock(mtx);
+
+		auto it = index.find(key);
+		if (it == index.end())
+			return false;
+
+		auto e = *it;
+		if (expired(*e, now()))
+			return false;
+
+		if (e->referenced.load(std::memory_order_relaxed) == 0) {
+			e->referenced.store(1, std::memory_order_relaxed);
+			pmem::obj::pool_by_vptr(this).persist(
+				&e->referenced, sizeof(e->referenced));
+		}
+
+		value.assign(e->value.cdata(), e->value.size());
+
+		return true;
+	}
+
+	/* inserts or replaces the key, which expires after ttl ms (0: never) */
+	void
+	put(const std::string &key, const std::string &value, int64_t ttl = 0)
+	{
+		auto pop = pmem::obj::pool_by_vptr(this);
+		auto expires = ttl != 0 ? now() + ttl : 0;
+
+		transaction::run(pop, [&] {
+			auto it = index.find(key);
+			if (it != index.end()) {
+				auto old = *it;
+				unlink(old);
+				delete_persistent<entry>(old);
+			}
+
+			auto e = make_persistent<entry>(key, value, expires);
+			link(e);
+			index.insert(e->key, e);
+		}, mtx);
+
+		while (exceeds(8))
+			evict(BATCH);
+	}
+
+	/* returns false if there was no such key */
+	bool
+	erase(const std::string &key)
+	{
+		auto pop = pmem::obj::pool_by_vptr(this);
+		bool found = false;
+
+		transaction::run(pop, [&] {
+			auto it = index.find(key);
+			if (it == index.end())
+				return;
+
+			remove(*it);
+			found = true;
+		}, mtx);
+
+		return found;
+	}
+
+	/*
+	 * Moves the hand by at most max_steps entries, in one transaction,
+	 * freeing expired entries and, while the cache is over its capacity,
+	 * those not accessed since the hand passed them last. Returns the
+	 * number of entries freed.
+	 */
+	std::size_t
+	evict(std::size_t max_steps)
+	{
+		auto pop = pmem::obj::pool_by_vptr(this);
+		auto t = now();
+		std::size_t freed = 0;
+
+		transaction::run(pop, [&] {
+			for (std::size_t n = 0; n < max_steps; n++) {
+				if (hand == nullptr)
+					break;
+
+				auto e = hand;
+				bool full = used > capacity;
+				bool unused = full &&
+					e->referenced.load(
+						std::memory_order_relaxed) == 0;
+
+				if (expired(*e, t) || unused) {
+					remove(e);
+					freed++;
+					continue;
+				}
+
+				if (full)
+					clear_referenced(*e);
+				hand = e->next;
+			}
+		}, mtx);
+
+		return freed;
+	}
+
+	/*
+	 * Reclaims index slots of removed entries, a bounded step at a time,
+	 * see kv::compact(). Compaction moves the index's values, so it runs
+	 * with the cache locked exclusively, like every other modification.
+	 */
+	bool
+	compact(std::size_t max_slots = 1024)
+	{
+		std::unique_lock<pmem::obj::shared_mutex> lock(mtx);
+
+		return index.compact(max_slots);
+	}
+
+	void
+	set_capacity(uint64_t bytes)
+	{
+		auto pop = pmem::obj::pool_by_vptr(this);
+		transaction::run(pop, [&] { capacity = bytes; }, mtx);
+	}
+
+	uint64_t
+	capacity_bytes() const
+	{
+		shared_lock lock(mtx);
+
+		return capacity;
+	}
+
+	uint64_t
+	used_bytes() const
+	{
+		shared_lock lock(mtx);
+
+		return used;
+	}
+
+	bool
+	over_capacity() const
+	{
+		return exceeds(0);
+	}
+
+	uint64_t
+	size() const
+	{
+		shared_lock lock(mtx);
+
+		return count;
+	}
+
+	/* true if some entry has a time to live */
+	bool
+	has_expiring() const
+	{
+		shared_lock lock(mtx);
+
+		return expiring != 0;
+	}
+
+private:
+	using index_type = kv<ptl::string, persistent_ptr<entry>, N>;
+
+	struct shared_lock {
+		shared_lock(pmem::obj::shared_mutex &mtx) : mtx(mtx)
+		{
+			mtx.lock_shared();
+		}
+
+		~shared_lock()
+		{
+			mtx.unlock_shared();
+		}
+
+		pmem::obj::shared_mutex &mtx;
+	};
+
+	/* true if more than capacity + capacity / slack bytes are used */
+	bool
+	exceeds(uint64_t slack) const
+	{
+		shared_lock lock(mtx);
+
+		auto limit = capacity + (slack != 0 ? capacity / slack : 0);
+		return count != 0 && used > limit;
+	}
+
+	/* has to be called in a transaction, under the exclusive lock */
+	static void
+	clear_referenced(entry &e)
+	{
+		if (pmemobj_tx_add_range_direct(&e.referenced,
+						sizeof(e.referenced)) != 0)
+			throw pmem::transaction_error(pmemobj_errormsg());
+
+		e.referenced.store(0, std::memory_order_relaxed);
+	}
+
+	static bool
+	expired(const entry &e, int64_t t)
+	{
+		return e.expires != 0 && e.expires <= t;
+	}
+
+	/* puts e right behind the hand, has to be called in a transaction */
+	void
+	link(persistent_ptr<entry> e)
+	{
+		if (hand == nullptr) {
+			e->prev = e->next = e;
+			hand = e;
+		} else {
+			e->next = hand;
+			e->prev = hand->prev;
+			hand->prev->next = e;
+			hand->prev = e;
+		}
+
+		used = used + e->bytes();
+		count = count + 1;
+		if (e->expires != 0)
+			expiring = expiring + 1;
+	}
+
+	/* has to be called in a transaction */
+	void
+	unlink(persistent_ptr<entry> e)
+	{
+		if (e->next == e) {
+			hand = nullptr;
+		} else {
+			e->prev->next = e->next;
+			e->next->prev = e->prev;
+			if (hand == e)
+				hand = e->next;
+		}
+
+		used = used - e->bytes();
+		count = count - 1;
+		if (e->expires != 0)
+			expiring = expiring - 1;
+	}
+
+	/* unlinks, unindexes and frees e, has to be called in a transaction */
+	void
+	remove(persistent_ptr<entry> e)
+	{
+		unlink(e);
+		index.erase(e->key);
+		delete_persistent<entry>(e);
+	}
+
+	index_type index;
+
+	/* next entry to look at, nullptr if the cache is empty */
+	persistent_ptr<entry> hand;
+
+	p<uint64_t> capacity;
+	p<uint64_t> used;
+	p<uint64_t> count;
+
+	/* number of entries with a time to live */
+	p<uint64_t> expiring;
+
+	/* shared by get() and the getters, exclusive for modifications */
+	mutable pmem::obj::shared_mutex mtx;
+};
+
+/*
+ * Background thread which keeps the cache within its capacity and frees
+ * expired entries. Has to be stopped (or destroyed) before the pool is
+ * closed.
+ */
+template <typename Cache>
+class cache_evictor {
+public:
+	cache_evictor(Cache &c, std::chrono::milliseconds interval =
+					std::chrono::milliseconds(100))
+	    : c(c), interval(interval), thread([this] { run(); })
+	{
+	}
+
+	~cache_evictor()
+	{
+		stop();
+	}
+
+	void
+	stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+		}
+		cv.notify_all();
+
+		if (thread.joinable())
+			thread.join();
+	}
+
+private:
+	bool
+	stopped()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		return stopping;
+	}
+
+	void
+	run()
+	{
+		while (!stopped()) {
+			std::size_t freed = 0;
+
+			while (c.over_capacity() && !stopped())
+				freed += c.evict(Cache::BATCH);
+
+			/* one sweep for expired entries, if any can expire */
+			auto size = c.has_expiring() ? c.size() : 0;
+			for (uint64_t n = 0; n < size && !stopped();
+			     n += Cache::BATCH)
+				freed += c.evict(Cache::BATCH);
+
+			if (freed != 0) {
+				while (c.compact() && !stopped())
+					;
+			}
+
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait_for(lock, interval,
+				    [this] { return stopping; });
+		}
+	}
+
+	Cache &c;
+	std::chrono::milliseconds interval;
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool stopping = false;
+
+	/* last, so that it starts after everything else is initialized */
+	std::thread thread;
+};
+
+} /* namespace examples */
+
+#endif /* SIMPLEKV_CACHE_HPP */
@@ -36,9 +36,14 @@
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/pext.hpp>
 #include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/shared_mutex.hpp>
 #include <libpmemobj++/transaction.hpp>
+#include <libpmemobj++/utils.hpp>
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace std
 {
@@ -71,6 +76,15 @@ using pmem::obj::transaction;
  * Key - type of the key
  * Value - type of the value stored in hashmap
  * N - Size of hashmap
+ *
+ * Values are stored in a vector and bucket entries refer to them by index.
+ * Erased (or replaced) values leave dead slots behind, which are reclaimed
+ * by compact(), in small transactions, while the kv stays usable.
+ *
+ * Every modification gets a new version and slots remember the version in
+ * which they died, so a snapshot can iterate over the values as they were
+ * when it was taken (but not over the objects they point to), while
+ * inserts continue.
  */
 template <typename Key, typename Value, std::size_t N>
 class kv {
@@ -78,45 +92,612 @@ private:
 	using bucket_type = ptl::vector<std::pair<Key, std::size_t>>;
 	using table_type = ptl::array<bucket_type, N>;
 
+	/* owner of a dead value slot */
+	static const uint64_t DEAD = std::numeric_limits<uint64_t>::max();
+
 	table_type table;
 	ptl::vector<Value> values;
 
+	/* bucket which refers to each of values, or DEAD */
+	ptl::vector<uint64_t> owners;
+
+	/* version in which each of values died, 0 while it's live */
+	ptl::vector<uint64_t> died;
+
+	/* version of the last modification */
+	p<uint64_t> version;
+
+	/* slots [0, compacted) are done, [compacted, scanned) are dead */
+	p<uint64_t> compacted;
+	p<uint64_t> scanned;
+
+	/* shared by lookups, exclusive for modifications */
+	pmem::obj::shared_mutex mtx;
+
+	/* held shared by snapshots, compaction waits until there are none */
+	pmem::obj::shared_mutex snapshot_mtx;
+
+	struct shared_lock {
+		shared_lock(pmem::obj::shared_mutex &mtx) : mtx(mtx)
+		{
+			mtx.lock_shared();
+		}
+
+		~shared_lock()
+		{
+			mtx.unlock_shared();
+		}
+
+		pmem::obj::shared_mutex &mtx;
+	};
+
+	/*
+	 * Returns the slot of the key's value or values.size() if none. K has
+	 * to compare with Key and hash like it, e.g. std::string for
+	 * ptl::string keys.
+	 */
+	template <typename K>
+	std::size_t
+	lookup(const K &key) const
+	{
+		const auto &bucket = table[std::hash<K>{}(key) % N];
+		for (auto e = bucket.cbegin(); e != bucket.cend(); ++e) {
+			if (e->first == key)
+				return e->second;
+		}
+
+		return values.size();
+	}
+
+	static void
+	prefetch(const void *addr)
+	{
+#if defined(__GNUC__)
+		__builtin_prefetch(addr);
+#else
+		(void)addr;
+#endif
+	}
+
+	std::pair<Key, std::size_t> *
+	find_entry(std::size_t index, const Key &key)
+	{
+		auto &bucket = table[index];
+		for (std::size_t i = 0; i < bucket.size(); i++) {
+			if (bucket.const_at(i).first == key)
+				return &bucket[i];
+		}
+
+		return nullptr;
+	}
+
+	/* frees unused capacity of the vectors, if they are small enough */
+	void
+	shrink(pmem::obj::pool_base &pop, std::size_t max_slots)
+	{
+		transaction::run(pop, [&] {
+			if (values.size() > max_slots ||
+			    values.capacity() <= 2 * values.size())
+				return;
+
+			values.shrink_to_fit();
+			owners.shrink_to_fit();
+			died.shrink_to_fit();
+		}, mtx);
+	}
+
+	/* has to be called in a transaction */
+	void
+	kill(std::size_t slot)
+	{
+		owners[slot] = DEAD;
+		died[slot] = version;
+	}
+
+	/* moves the value at src to dst, has to be called in a transaction */
+	void
+	move(std::size_t src, std::size_t dst)
+	{
+		auto &bucket = table[owners.const_at(src)];
+		for (std::size_t i = 0; i < bucket.size(); i++) {
+			if (bucket.const_at(i).second == src) {
+				bucket[i].second = dst;
+				break;
+			}
+		}
+
+		values[dst] = values.const_at(src);
+		owners[dst] = owners.const_at(src);
+		died[dst] = 0;
+		kill(src);
+	}
+
+	/* appends values visible in version from [from, to), returns next */
+	std::size_t
+	copy(std::size_t from, std::size_t to, uint64_t version,
+	     std::vector<Value> &buf)
+	{
+		shared_lock lock(mtx);
+
+		auto last = std::min(to, from + snapshot::BATCH);
+		for (; from < last; from++) {
+			auto d = died.const_at(from);
+			if (d == 0 || d > version)
+				buf.push_back(values.const_at(from));
+		}
+
+		return from;
+	}
+
 public:
+	using key_type = Key;
 	using value_type = Value;
 
-	kv() = default;
+	/* iterates over live values, in the order of insertion */
+	class iterator {
+	public:
+		iterator(kv *map, std::size_t pos) : map(map), pos(pos)
+		{
+			skip();
+		}
+
+		Value &operator*() const
+		{
+			return map->values[pos];
+		}
+
+		Value *operator->() const
+		{
+			return &**this;
+		}
+
+		iterator &operator++()
+		{
+			pos++;
+			skip();
+			return *this;
+		}
+
+		bool
+		operator==(const iterator &rhs) const
+		{
+			return pos == rhs.pos;
+		}
+
+		bool
+		operator!=(const iterator &rhs) const
+		{
+			return pos != rhs.pos;
+		}
+
+	private:
+		void
+		skip()
+		{
+			while (pos < map->owners.size() &&
+			       map->owners.const_at(pos) == DEAD)
+				pos++;
+		}
+
+		kv *map;
+		std::size_t pos;
+	};
+
+	/*
+	 * Point-in-time view of the values. Values are copied out in batches,
+	 * under the lookup lock, so they have to be copyable to volatile
+	 * memory (e.g. trivially copyable types or persistent_ptr).
+	 *
+	 * The view is shallow: only the values are versioned, not what they
+	 * point to. With persistent_ptr values the objects have to be treated
+	 * as immutable while a snapshot exists; to change one, insert a new
+	 * object under the key and free the old one only after the snapshots
+	 * are gone. The kv itself never frees what its values point to.
+	 */
+	class snapshot {
+	public:
+		static const std::size_t BATCH = 256;
+
+		class iterator {
+		public:
+			iterator(snapshot *snap) : snap(snap), pos(0), next(0)
+			{
+				fill();
+			}
+
+			const Value &operator*() const
+			{
+				return buf[pos];
+			}
+
+			const Value *operator->() const
+			{
+				return &buf[pos];
+			}
+
+			iterator &operator++()
+			{
+				if (++pos == buf.size())
+					fill();
+				return *this;
+			}
+
+			/* only tells apart finished iterators from the others */
+			bool
+			operator==(const iterator &rhs) const
+			{
+				return done() == rhs.done();
+			}
+
+			bool
+			operator!=(const iterator &rhs) const
+			{
+				return !(*this == rhs);
+			}
+
+		private:
+			bool
+			done() const
+			{
+				return snap == nullptr || pos == buf.size();
+			}
+
+			void
+			fill()
+			{
+				buf.clear();
+				pos = 0;
+
+				if (snap == nullptr)
+					return;
+
+				while (buf.empty() && next < snap->size)
+					next = snap->map.copy(next, snap->size,
+							      snap->version, buf);
+			}
+
+			snapshot *snap;
+			std::vector<Value> buf;
+			std::size_t pos;
+			std::size_t next;
+		};
+
+		snapshot(kv &map) : map(map)
+		{
+			map.snapshot_mtx.lock_shared();
+
+			shared_lock lock(map.mtx);
+			version = map.version;
+			size = map.values.size();
+		}
+
+		snapshot(const snapshot &) = delete;
+		snapshot &operator=(const snapshot &) = delete;
+
+		~snapshot()
+		{
+			map.snapshot_mtx.unlock_shared();
+		}
+
+		iterator
+		begin()
+		{
+			return iterator(this);
+		}
+
+		iterator
+		end()
+		{
+			return iterator(nullptr);
+		}
+
+	private:
+		kv &map;
+		uint64_t version;
+		std::size_t size;
+	};
+
+	kv() : version(1), compacted(0), scanned(0)
+	{
+	}
 
 	Value &
 	at(const Key &key)
 	{
-		auto index = std::hash<Key>{}(key) % N;
+		shared_lock lock(mtx);
 
-		for (const auto &e : table[index])
-		{
-			if (e.first == key)
-				return values[e.second];
+		auto slot = lookup(key);
+		if (slot == values.size())
+			throw std::out_of_range("no entry in simplekv");
+
+		return values[slot];
+	}
+
+	/* like at(), but returns end() if there is no such key */
+	template <typename K>
+	iterator
+	find(const K &key)
+	{
+		shared_lock lock(mtx);
+
+		return iterator(this, lookup(key));
+	}
+
+	/* number of lookups find_batch() keeps in flight */
+	static const std::size_t BATCH_GROUP = 16;
+
+	/*
+	 * Looks up n keys, out[i] is what find(keys[i]) would return.
+	 *
+	 * A single lookup stalls on every dependent load from pmem: the
+	 * bucket's vector, its entries, the value. Here up to BATCH_GROUP
+	 * lookups are interleaved as small state machines; every step
+	 * prefetches what its lookup needs next and moves on to the next
+	 * lookup, so that the loads of all of them overlap.
+	 */
+	template <typename K>
+	void
+	find_batch(const K *keys, std::size_t n, std::vector<iterator> &out)
+	{
+		shared_lock lock(mtx);
+
+		enum stage { BUCKET, ENTRIES, DONE };
+
+		struct lookup_state {
+			std::size_t key;
+			const bucket_type *bucket;
+			stage next;
+		};
+
+		const auto &tab = table;
+		auto vals = values.cdata();
+		auto owns = owners.cdata();
+		std::vector<std::size_t> slots(n, values.size());
+
+		lookup_state group[BATCH_GROUP];
+		std::size_t next_key = 0;
+		std::size_t active = 0;
+
+		/* starts a lookup of the next key in s, if there is one */
+		auto start = [&](lookup_state &s) {
+			if (next_key == n) {
+				s.next = DONE;
+				return;
+			}
+
+			s.key = next_key++;
+			s.bucket = &tab[std::hash<K>{}(keys[s.key]) % N];
+			s.next = BUCKET;
+			prefetch(s.bucket);
+			active++;
+		};
+
+		for (auto &s : group)
+			start(s);
+
+		while (active != 0) {
+			for (auto &s : group) {
+				if (s.next == DONE)
+					continue;
+
+				if (s.next == BUCKET && s.bucket->size() != 0) {
+					prefetch(s.bucket->cdata());
+					s.next = ENTRIES;
+					continue;
+				}
+
+				if (s.next == ENTRIES) {
+					for (auto e = s.bucket->cbegin();
+					     e != s.bucket->cend(); ++e) {
+						if (!(e->first == keys[s.key]))
+							continue;
+
+						/* read by iterator and caller */
+						slots[s.key] = e->second;
+						prefetch(&vals[e->second]);
+						prefetch(&owns[e->second]);
+						break;
+					}
+				}
+
+				active--;
+				start(s);
+			}
 		}
 
-		throw std::out_of_range("no entry in simplekv");
+		out.clear();
+		out.reserve(n);
+		for (auto slot : slots)
+			out.emplace_back(this, slot);
 	}
 
+	/* calls f for every key, in no particular order */
+	template <typename F>
+	void
+	for_each_key(F f)
+	{
+		shared_lock lock(mtx);
+
+		for (std::size_t i = 0; i < N; i++) {
+			const auto &bucket = table[i];
+			for (auto e = bucket.cbegin(); e != bucket.cend(); ++e)
+				f(e->first);
+		}
+	}
+
+	/* inserts the key, or replaces its value if it already exists */
 	void
 	insert(const Key &key, const Value &val)
 	{
+		auto pop = pmem::obj::pool_by_vptr(this);
 		auto index = std::hash<Key>{}(key) % N;
 
-		values.emplace_back(val);
-		table[index].emplace_back(key, values.size() - 1);
+		transaction::run(pop, [&] {
+			version = version + 1;
+
+			values.emplace_back(val);
+			owners.emplace_back(index);
+			died.emplace_back(0);
+
+			auto e = find_entry(index, key);
+			if (e == nullptr) {
+				table[index].emplace_back(key, values.size() - 1);
+			} else {
+				kill(e->second);
+				e->second = values.size() - 1;
+			}
+		}, mtx);
+	}
+
+	/* returns false if there was no such key */
+	bool
+	erase(const Key &key)
+	{
+		auto pop = pmem::obj::pool_by_vptr(this);
+		auto index = std::hash<Key>{}(key) % N;
+		bool found = false;
+
+		transaction::run(pop, [&] {
+			auto &bucket = table[index];
+			for (std::size_t i = 0; i < bucket.size(); i++) {
+				if (bucket.const_at(i).first != key)
+					continue;
+
+				version = version + 1;
+				kill(bucket.const_at(i).second);
+				if (i != bucket.size() - 1)
+					bucket[i] = bucket.const_at(
+						bucket.size() - 1);
+				bucket.pop_back();
+
+				found = true;
+				break;
+			}
+		}, mtx);
+
+		return found;
+	}
+
+	/*
+	 * Moves at most max_slots live values down over the dead ones, or
+	 * once the end is reached, drops at most max_slots dead slots from
+	 * the end, in a single transaction, so it can be called repeatedly
+	 * alongside other operations. When nothing is left to drop the next
+	 * call starts a new pass and false is returned. At the end of a pass
+	 * the vectors are shrunk, in a separate transaction, if they are
+	 * mostly empty and hold at most max_slots values; larger ones keep
+	 * their capacity for later inserts, as shrinking copies them whole.
+	 *
+	 * Moving values invalidates references returned by at() and
+	 * running iterations (but not snapshots). While any snapshot exists
+	 * nothing is moved and false is returned, so loops calling it until
+	 * it returns false end; the pass goes on with the next call made
+	 * after the snapshots are gone.
+	 */
+	bool
+	compact(std::size_t max_slots = 1024)
+	{
+		if (!snapshot_mtx.try_lock())
+			return false;
+
+		auto pop = pmem::obj::pool_by_vptr(this);
+		bool more = true;
+
+		transaction::run(pop, [&] {
+			auto dst = compacted.get_ro();
+			auto src = scanned.get_ro();
+			std::size_t n = 0;
+
+			for (; n < max_slots && src < values.size(); n++, src++) {
+				if (owners.const_at(src) == DEAD)
+					continue;
+
+				if (src != dst)
+					move(src, dst);
+				dst++;
+			}
+
+			/* all of [dst, src) is dead once the end is reached */
+			if (src == values.size() && n < max_slots && dst < src) {
+				auto k = std::min(max_slots - n, src - dst);
+
+				values.erase(values.cend() - k, values.cend());
+				owners.erase(owners.cend() - k, owners.cend());
+				died.erase(died.cend() - k, died.cend());
+				src -= k;
+			}
+
+			if (src == values.size() && dst == src) {
+				dst = src = 0;
+				more = false;
+			}
+
+			compacted = dst;
+			scanned = src;
+		}, mtx);
+
+		if (!more)
+			shrink(pop, max_slots);
+		snapshot_mtx.unlock();
+
+		return more;
+	}
+
+	/* number of slots taken by erased or replaced values */
+	std::size_t
+	dead() const
+	{
+		std::size_t n = 0;
+		for (std::size_t i = 0; i < owners.size(); i++)
+			n += owners.const_at(i) == DEAD;
+
+		return n;
+	}
+
+	/*
+	 * Throws std::logic_error if any key is stored in a wrong bucket,
+	 * more than once or points outside of values or to a dead slot.
+	 */
+	void
+	check() const
+	{
+		if (owners.size() != values.size() ||
+		    died.size() != values.size())
+			throw std::logic_error("values and owners differ");
+
+		for (std::size_t i = 0; i < N; i++) {
+			const auto &bucket = table[i];
+
+			for (auto e = bucket.cbegin(); e != bucket.cend(); ++e) {
+				if (std::hash<Key>{}(e->first) % N != i)
+					throw std::logic_error(
+						"key stored in a wrong bucket");
+				if (e->second >= values.size())
+					throw std::logic_error(
+						"key points outside of values");
+				if (owners.const_at(e->second) != i)
+					throw std::logic_error(
+						"key points to a dead value");
+
+				for (auto o = bucket.cbegin(); o != e; ++o) {
+					if (o->first == e->first)
+						throw std::logic_error(
+							"duplicated key");
+				}
+			}
+		}
 	}
 
-	auto begin() -> decltype(values.begin())
+	iterator
+	begin()
 	{
-		return values.begin();
+		return iterator(this, 0);
 	}
 
-	auto end() -> decltype(values.end())
+	iterator
+	end()
 	{
-		return values.end();
+		return iterator(this, values.size());
 	}
 };
 
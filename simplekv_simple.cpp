@@ -38,6 +38,7 @@
  *	pmempool create obj --layout=simplekv -s 1G word_count
  */
 
+#include "pool_open.hpp"
 #include "simplekv.hpp"
 
 static const std::string LAYOUT = "simplekv";
@@ -67,7 +68,7 @@ main(int argc, char *argv[])
 
 	auto path = argv[1];
 
-	auto pop = pool<root>::open(path, LAYOUT);
+	auto pop = examples::open_pool<root>(path, LAYOUT);
 	auto r = pop.root();
 
 	if (r->simplekv != nullptr) {
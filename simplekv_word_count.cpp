@@ -35,20 +35,50 @@
  * for counting words in text files.
  *
  * create the pool for this program using pmempool, for example:
- *	pmempool create obj --layout=simplekv -s 1G word_count
+ *	pmempool create obj --layout=word_count_v2 -s 1G word_count
+ *
+ * Files which were already read are skipped on subsequent runs, unless they
+ * were modified, and files which were read partially (e.g. because the
+ * program crashed) are read from where it stopped.
+ *
+ * --readers, --tokenizers and --committers set the number of threads of
+ * each stage of the ingest pipeline.
+ *
+ * with --top K and/or --min-count C only the K most frequent words
+ * (with at least C occurrences) are printed, sorted by count. Those are
+ * selected in a streaming pass, so the full word count is never built.
+ *
+ * On a machine with more than one NUMA node the counting threads are pinned
+ * to the nodes and every file is counted by a thread on the node its words
+ * are stored on, the committers run on the node of the pool.
+ * --numa-stats 1 prints how many bytes were read locally and remotely.
+ *
+ * With --compress 1 new columns are stored as varints (usually less than
+ * half of the size), pool_stats reports the ratio.
  */
 
-#include "simplekv_optimized.hpp"
+#include "bounded_queue.hpp"
+#include "heavy_hitters.hpp"
+#include "histogram.hpp"
+#include "numa_topology.hpp"
+#include "word_count.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <set>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-static const std::string LAYOUT = "simplekv";
-
 using pmem::obj::delete_persistent;
 using pmem::obj::make_persistent;
 using pmem::obj::p;
@@ -58,56 +88,510 @@ using pmem::obj::transaction;
 
 namespace ptl = pmem::obj::experimental;
 
-using simplekv_type =
-	examples::kv<ptl::string, ptl::vector<ptl::string>, (1 << 20)>;
-using word_count_kv = std::unordered_map<std::string, uint64_t>;
+using column_type = examples::word_count::column_type;
+using simplekv_type = examples::word_count::kv_type;
+using journal_type = examples::word_count::journal_type;
+using reservation_type = column_type::reservation;
+using word_count_kv = std::vector<uint64_t>;
+using sparse_counts = std::vector<std::pair<uint32_t, uint64_t>>;
+using root = examples::word_count::root;
+
+/* size of a piece of a file read at once (rounded up to a word boundary) */
+static const std::size_t CHUNK_BYTES = 1 << 20;
+
+/*
+ * a counting thread which sees fewer than dictionary size / SPARSE_RATIO ids
+ * counts them in a hash map instead of a histogram of the whole dictionary
+ */
+static const std::size_t SPARSE_RATIO = 8;
 
-struct root {
-	persistent_ptr<simplekv_type> simplekv;
+/* number of words committed in a single transaction */
+static const std::size_t BATCH_WORDS = 1 << 18;
+
+/* capacity of the queues between the pipeline stages */
+static const std::size_t QUEUE_CHUNKS = 16;
+
+struct chunk {
+	std::size_t file; /* index of the file in the input list */
+	uint64_t seq;	  /* position of the chunk in the file */
+	uint64_t end;	  /* file offset right after the chunk */
+	bool last;
+
+	std::string text;
+	std::vector<std::string> words;
 };
 
-void
-read_file(pool<root> &pop, const std::string &fname)
+/*
+ * Ingests files in three stages connected by bounded queues: readers read
+ * chunks of files, tokenizers split them into words and committers intern
+ * the words and append them to the files' columns, batching chunks (also of
+ * different files) into a single transaction.
+ *
+ * Every chunk updates the file's journal entry in the same transaction, so
+ * a file which was already read is skipped and one which was read partially
+ * is resumed from its last committed chunk.
+ *
+ * A committer claims a batch of chunks under a lock and then writes and
+ * commits it on its own; the files of a claimed batch are busy until it is
+ * committed, so every file is appended to by one committer at a time, in
+ * order. Only interning words into the shared dictionary is serialized.
+ */
+class ingest {
+public:
+	/* with pack the segments are stored encoded */
+	ingest(pool<root> &pop, examples::word_dict &dict,
+	       const std::vector<std::string> &files, bool pack)
+	    : pop(pop),
+	      dict(dict),
+	      files(files),
+	      pack(pack),
+	      entries(files.size()),
+	      next_seq(files.size(), 0),
+	      busy(files.size(), false),
+	      texts(QUEUE_CHUNKS),
+	      tokens(QUEUE_CHUNKS)
+	{
+	}
+
+	/* committers are pinned to commit_node, unless it's -1 */
+	void
+	run(unsigned readers, unsigned tokenizers, unsigned committers,
+	    const examples::numa_topology &topo, int commit_node)
+	{
+		std::vector<std::thread> read_threads, tokenize_threads,
+			commit_threads;
+
+		for (unsigned i = 0; i < committers; i++) {
+			commit_threads.emplace_back([&] {
+				if (commit_node >= 0)
+					topo.pin(commit_node);
+				commit();
+			});
+		}
+		for (unsigned i = 0; i < tokenizers; i++)
+			tokenize_threads.emplace_back([&] { tokenize(); });
+		for (unsigned i = 0; i < readers; i++)
+			read_threads.emplace_back([&] { read(); });
+
+		for (auto &t : read_threads)
+			t.join();
+		texts.close();
+
+		for (auto &t : tokenize_threads)
+			t.join();
+		tokens.close();
+
+		for (auto &t : commit_threads)
+			t.join();
+	}
+
+private:
+	/*
+	 * returns journal entry of the file or nullptr if it's already read
+	 * (or being read, if it's given more than once)
+	 */
+	persistent_ptr<journal_type::entry_type>
+	prepare(const std::string &fname, const examples::file_id &id)
+	{
+		std::lock_guard<std::mutex> lock(commit_mtx);
+
+		if (!started.insert(fname).second)
+			return nullptr;
+
+		auto r = pop.root();
+		auto entry = r->journal->find(fname);
+
+		if (entry != nullptr && entry->done && entry->matches(id))
+			return nullptr;
+
+		transaction::run(pop, [&] {
+			if (entry == nullptr) {
+				entry = r->journal->add(fname, id);
+				entry->data = make_persistent<column_type>();
+				r->simplekv->insert(entry->path, entry->data);
+			} else if (!entry->matches(id)) {
+				entry->reset(id);
+				entry->data->clear();
+			}
+		});
+
+		return entry;
+	}
+
+	void
+	read()
+	{
+		for (;;) {
+			auto i = next_file++;
+			if (i >= files.size())
+				return;
+
+			examples::file_id id;
+			if (!examples::file_id::of(files[i], id)) {
+				std::cerr << "cannot access " << files[i]
+					  << std::endl;
+				continue;
+			}
+
+			auto entry = prepare(files[i], id);
+			if (entry == nullptr)
+				continue;
+
+			entries[i] = entry;
+
+			std::ifstream file(files[i], std::ios::binary);
+			uint64_t offset = entry->offset;
+			file.seekg(static_cast<std::streamoff>(offset));
+
+			for (uint64_t seq = 0;; seq++) {
+				chunk c;
+				c.file = i;
+				c.seq = seq;
+
+				c.text.resize(CHUNK_BYTES);
+				file.read(&c.text[0], CHUNK_BYTES);
+				c.text.resize(file.gcount());
+
+				/* do not split the last word */
+				char ch;
+				while (file.get(ch)) {
+					c.text.push_back(ch);
+					if (isspace((unsigned char)ch))
+						break;
+				}
+
+				offset += c.text.size();
+				c.end = offset;
+				c.last = !file;
+
+				texts.push(std::move(c));
+
+				if (!file)
+					break;
+			}
+		}
+	}
+
+	void
+	tokenize()
+	{
+		chunk c;
+		while (texts.pop(c)) {
+			std::string word;
+			bool in_word = false;
+
+			for (char ch : c.text) {
+				if (isspace((unsigned char)ch)) {
+					if (in_word)
+						c.words.push_back(word);
+					word.clear();
+					in_word = false;
+				} else {
+					in_word = true;
+					if (isalpha((unsigned char)ch))
+						word.push_back(ch);
+				}
+			}
+
+			if (in_word)
+				c.words.push_back(word);
+
+			c.text.clear();
+			tokens.push(std::move(c));
+		}
+	}
+
+	void
+	commit()
+	{
+		chunk c;
+		while (tokens.pop(c)) {
+			std::vector<chunk> batch;
+			{
+				std::lock_guard<std::mutex> lock(commit_mtx);
+
+				auto key = std::make_pair(c.file, c.seq);
+				pending.emplace(key, std::move(c));
+
+				batch = claim(BATCH_WORDS);
+			}
+
+			if (!batch.empty())
+				commit_batch(batch);
+		}
+
+		/* whatever is left, once the files other committers hold are done */
+		for (;;) {
+			std::vector<chunk> batch;
+			{
+				std::lock_guard<std::mutex> lock(commit_mtx);
+				batch = claim(0);
+			}
+
+			if (batch.empty())
+				return;
+
+			commit_batch(batch);
+		}
+	}
+
+	/*
+	 * Takes chunks which are next in their files, of files no other
+	 * committer holds, up to BATCH_WORDS words and marks their files busy.
+	 * Returns nothing if there are fewer than min_words words. Has to be
+	 * called with commit_mtx held.
+	 */
+	std::vector<chunk>
+	claim(std::size_t min_words)
+	{
+		std::vector<chunk> batch;
+		std::vector<std::size_t> taken;
+		std::size_t words = 0;
+
+		for (auto it = pending.begin();
+		     it != pending.end() && words < BATCH_WORDS;) {
+			auto &c = it->second;
+			if (c.seq != next_seq[c.file] ||
+			    (busy[c.file] &&
+			     std::find(taken.begin(), taken.end(), c.file) ==
+				     taken.end())) {
+				++it;
+				continue;
+			}
+
+			if (!busy[c.file]) {
+				busy[c.file] = true;
+				taken.push_back(c.file);
+			}
+
+			next_seq[c.file]++;
+			words += c.words.size();
+			batch.push_back(std::move(c));
+			it = pending.erase(it);
+		}
+
+		if (batch.empty() || words >= min_words)
+			return batch;
+
+		/* too small, keep it for the next call */
+		for (auto &c : batch) {
+			next_seq[c.file]--;
+			busy[c.file] = false;
+			auto key = std::make_pair(c.file, c.seq);
+			pending.emplace(key, std::move(c));
+		}
+
+		return {};
+	}
+
+	/*
+	 * Words are interned first, so that the ids can be written to new
+	 * segments outside of a transaction. Those are then linked to the
+	 * columns together with the journal update. A crash in between leaves
+	 * only unused words in the dictionary.
+	 */
+	void
+	commit_batch(std::vector<chunk> &batch)
+	{
+		std::vector<std::vector<uint32_t>> ids(batch.size());
+
+		{
+			std::lock_guard<std::mutex> lock(dict_mtx);
+			transaction::run(pop, [&] {
+				for (std::size_t i = 0; i < batch.size(); i++) {
+					ids[i].reserve(batch[i].words.size());
+					for (const auto &w : batch[i].words)
+						ids[i].push_back(dict.intern(w));
+				}
+			});
+		}
+
+		std::vector<std::unique_ptr<reservation_type>> segments;
+		for (const auto &v : ids)
+			segments.emplace_back(
+				new reservation_type(pop, v.data(), v.size(),
+						     pack));
+
+		transaction::run(pop, [&] {
+			for (std::size_t i = 0; i < batch.size(); i++) {
+				auto &entry = entries[batch[i].file];
+				entry->data->append(*segments[i]);
+				entry->offset = batch[i].end;
+				entry->done = batch[i].last;
+			}
+		});
+
+		std::lock_guard<std::mutex> lock(commit_mtx);
+		for (const auto &c : batch)
+			busy[c.file] = false;
+	}
+
+	pool<root> &pop;
+	examples::word_dict &dict;
+	const std::vector<std::string> &files;
+	bool pack;
+	std::vector<persistent_ptr<journal_type::entry_type>> entries;
+
+	std::atomic<std::size_t> next_file{0};
+
+	/* serializes interning, the dictionary is shared by all committers */
+	std::mutex dict_mtx;
+
+	/* protects everything below and the journal */
+	std::mutex commit_mtx;
+	std::map<std::pair<std::size_t, uint64_t>, chunk> pending;
+	std::vector<uint64_t> next_seq;
+	std::vector<bool> busy; /* files of batches being committed */
+	std::set<std::string> started;
+
+	examples::bounded_queue<chunk> texts;
+	examples::bounded_queue<chunk> tokens;
+};
+
+/* a counting thread, the node it runs on (or -1) and the files it counts */
+struct map_task {
+	int node = -1;
+	std::vector<const column_type *> columns;
+	uint64_t words = 0;
+};
+
+/* bytes read by the counting threads from their own and from other nodes */
+struct numa_traffic {
+	std::atomic<uint64_t> local{0};
+	std::atomic<uint64_t> remote{0};
+};
+
+/* node of every segment of the column, pool_node where it's not known */
+std::vector<int>
+segment_nodes(const column_type &column, int pool_node)
 {
-	std::ifstream file;
-	file.open(fname);
+	std::vector<const void *> addrs;
+	for (const auto &s : column.segments())
+		addrs.push_back(s.data.get());
 
-	auto r = pop.root();
+	std::vector<int> nodes;
+	examples::numa_topology::page_nodes(addrs, nodes);
+	for (auto &n : nodes)
+		if (n < 0)
+			n = pool_node;
+
+	return nodes;
+}
+
+/*
+ * Splits the files between nthreads counting threads. With more than one
+ * node, threads are spread over the nodes like the CPUs are and every file
+ * goes to the least loaded thread on the node of its first segment (or the
+ * nearest one with CPUs). Otherwise files are dealt out by size.
+ */
+std::vector<map_task>
+plan_map(simplekv_type::snapshot &snap, const examples::numa_topology &topo,
+	 int pool_node, unsigned nthreads)
+{
+	std::vector<map_task> tasks(nthreads);
+
+	std::vector<int> cpu_node;
+	for (auto id : topo.cpu_nodes()) {
+		for (std::size_t i = 0; i < topo.find(id)->cpus.size(); i++)
+			cpu_node.push_back(id);
+	}
 
-	transaction::run(pop, [&] {
-		auto vec = make_persistent<ptl::vector<ptl::string>>();
-		auto pname = make_persistent<ptl::string>(fname);
-
-		std::string word;
-		while (file >> word) {
-			vec->emplace_back(
-				word.begin(),
-				std::remove_if(
-					word.begin(), word.end(),
-					[](char c) { return !isalpha(c); }));
+	bool numa = topo.cpu_nodes().size() > 1;
+	if (numa) {
+		for (unsigned i = 0; i < nthreads; i++)
+			tasks[i].node = cpu_node[i % cpu_node.size()];
+	}
+
+	for (const auto &column : snap) {
+		int home = -1;
+		if (numa && !column->segments().empty())
+			home = topo.nearest_cpu_node(
+				segment_nodes(*column, pool_node)[0]);
+
+		map_task *best = nullptr;
+		for (auto &t : tasks) {
+			if (home >= 0 && t.node != home)
+				continue;
+			if (best == nullptr || t.words < best->words)
+				best = &t;
 		}
 
-		r->simplekv->insert(*pname, *vec);
+		/* no thread on that node, any will do */
+		if (best == nullptr) {
+			for (auto &t : tasks)
+				if (best == nullptr || t.words < best->words)
+					best = &t;
+		}
 
-		delete_persistent<ptl::vector<ptl::string>>(vec);
-		delete_persistent<ptl::string>(pname);
-	});
+		best->columns.push_back(column.get());
+		best->words += column->size();
+	}
+
+	return tasks;
 }
 
-word_count_kv
-map(const simplekv_type::value_type &vec)
+/*
+ * counts words of the task's files into a histogram private to the calling
+ * thread, which is first pinned to the task's node, or into a hash map if
+ * the task is small compared to the dictionary; returns the non-zero counts
+ */
+sparse_counts
+map(const map_task &task, std::size_t dict_size,
+    const examples::numa_topology &topo, int pool_node,
+    numa_traffic &traffic)
 {
-	word_count_kv map;
+	if (task.node >= 0)
+		topo.pin(task.node);
+
+	bool dense = task.words >= dict_size / SPARSE_RATIO;
+	examples::histogram hist(dense ? dict_size : 0);
+	std::unordered_map<uint32_t, uint64_t> counts;
+	std::vector<uint32_t> buf;
+	uint64_t local = 0, remote = 0;
 
-	for (const auto &e : vec) {
-		map[std::string(e.c_str())]++;
+	for (auto column : task.columns) {
+		column->for_each_run(buf, [&](const uint32_t *ids,
+					      std::size_t n) {
+			if (dense) {
+				hist.add(ids, n);
+				return;
+			}
+
+			for (std::size_t i = 0; i < n; i++)
+				counts[ids[i]]++;
+		});
+
+		auto nodes = segment_nodes(*column, pool_node);
+
+		/* task.node has CPUs, the memory's node may have none */
+		std::size_t i = 0;
+		for (const auto &s : column->segments()) {
+			auto node = topo.nearest_cpu_node(nodes[i]);
+			if (task.node < 0 || node == task.node)
+				local += s.bytes;
+			else if (node >= 0)
+				remote += s.bytes;
+			i++;
+		}
+	}
+
+	traffic.local += local;
+	traffic.remote += remote;
+
+	sparse_counts result(counts.begin(), counts.end());
+	if (dense) {
+		const auto &totals = hist.result();
+		for (std::size_t id = 0; id < totals.size(); id++) {
+			if (totals[id] != 0)
+				result.emplace_back(id, totals[id]);
+		}
 	}
 
-	return map;
+	return result;
 }
 
 word_count_kv &
-reduce(word_count_kv &m1, const word_count_kv &m2)
+reduce(word_count_kv &m1, const sparse_counts &m2)
 {
 	for (const auto &e : m2)
 		m1[e.first] += e.second;
@@ -115,39 +599,154 @@ reduce(word_count_kv &m1, const word_count_kv &m2)
 	return m1;
 }
 
+void
+print_top(simplekv_type &kv, const examples::word_dict &dict, std::size_t top,
+	  uint64_t min_count)
+{
+	/* keep a few times more candidates than needed to absorb sketch error */
+	auto capacity = top != 0 ? top * 4
+				 : std::numeric_limits<std::size_t>::max();
+	examples::heavy_hitters<uint32_t> hitters(capacity, min_count);
+
+	/* both passes see the same files, even if more are being inserted */
+	simplekv_type::snapshot snap(kv);
+
+	std::vector<uint32_t> buf;
+
+	for (const auto &column : snap) {
+		column->for_each_run(buf, [&](const uint32_t *ids,
+					      std::size_t n) {
+			for (std::size_t i = 0; i < n; i++)
+				hitters.add(ids[i]);
+		});
+	}
+
+	/* second pass counts the candidates exactly */
+	auto counts = hitters.candidates();
+
+	for (const auto &column : snap) {
+		column->for_each_run(buf, [&](const uint32_t *ids,
+					      std::size_t n) {
+			for (std::size_t i = 0; i < n; i++) {
+				auto it = counts.find(ids[i]);
+				if (it != counts.end())
+					it->second++;
+			}
+		});
+	}
+
+	for (const auto &e : examples::select_top(counts, top, min_count))
+		std::cout << dict.word(e.first).c_str() << " " << e.second
+			  << std::endl;
+}
+
 int
 main(int argc, char *argv[])
 {
-	if (argc < 3) {
+	std::size_t top = 0;
+	uint64_t min_count = 0;
+	unsigned readers = 1;
+	unsigned tokenizers = std::max(1u, std::thread::hardware_concurrency());
+	unsigned committers = 1;
+	bool numa_stats = false;
+	bool compress = false;
+
+	int argn = 1;
+	for (; argn + 1 < argc; argn += 2) {
+		auto val = std::strtoull(argv[argn + 1], nullptr, 10);
+
+		if (strcmp(argv[argn], "--top") == 0)
+			top = val;
+		else if (strcmp(argv[argn], "--min-count") == 0)
+			min_count = val;
+		else if (strcmp(argv[argn], "--readers") == 0)
+			readers = std::max(1ULL, val);
+		else if (strcmp(argv[argn], "--tokenizers") == 0)
+			tokenizers = std::max(1ULL, val);
+		else if (strcmp(argv[argn], "--committers") == 0)
+			committers = std::max(1ULL, val);
+		else if (strcmp(argv[argn], "--numa-stats") == 0)
+			numa_stats = val != 0;
+		else if (strcmp(argv[argn], "--compress") == 0)
+			compress = val != 0;
+		else
+			break;
+	}
+
+	if (argc - argn < 2) {
 		std::cerr << "usage: " << argv[0]
+			  << " [--top K] [--min-count C] [--readers N]"
+			  << " [--tokenizers N] [--committers N]"
+			  << " [--numa-stats 1] [--compress 1]"
 			  << " file-name file1.txt file2.txt ..." << std::endl;
 		return 1;
 	}
 
-	auto path = argv[1];
+	auto path = argv[argn];
 
-	auto pop = pool<root>::open(path, LAYOUT);
+	auto pop = examples::word_count::open(path);
 	auto r = pop.root();
 
-	if (r->simplekv == nullptr) {
-		transaction::run(pop, [&]() {
-			r->simplekv = make_persistent<simplekv_type>();
-		});
+	examples::word_dict dict(r->words);
+
+	auto topo = examples::numa_topology::detect();
+	auto pool_node = examples::numa_topology::node_of_file(path);
+	bool numa = topo.cpu_nodes().size() > 1;
+
+	std::vector<std::string> files(argv + argn + 1, argv + argc);
+	ingest(pop, dict, files, compress)
+		.run(readers, tokenizers, committers, topo,
+		     numa ? topo.nearest_cpu_node(pool_node) : -1);
+
+	if (top != 0 || min_count != 0) {
+		print_top(*r->simplekv, dict, top, min_count);
+		pop.close();
+		return 0;
 	}
 
-	for (int argn = 2; argn < argc; argn++)
-		read_file(pop, argv[argn]);
+	auto nthreads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<sparse_counts> word_counts(nthreads);
+	std::vector<std::thread> threads;
+	numa_traffic traffic;
 
-	std::vector<word_count_kv> word_counts;
+	/*
+	 * the snapshot fixes the set of columns, their contents are not
+	 * versioned, but nothing modifies them while they are counted
+	 */
+	{
+		simplekv_type::snapshot snap(*r->simplekv);
+		auto tasks = plan_map(snap, topo, pool_node, nthreads);
 
-	std::transform(r->simplekv->begin(), r->simplekv->end(),
-			   std::back_inserter(word_counts), map);
+		for (unsigned i = 0; i < nthreads; i++) {
+			threads.emplace_back([&, i] {
+				word_counts[i] = map(tasks[i], dict.size(),
+						     topo, pool_node, traffic);
+			});
+		}
+
+		for (auto &t : threads)
+			t.join();
+	}
+
+	if (numa_stats) {
+		uint64_t total = traffic.local + traffic.remote;
+		std::cerr << "numa: " << topo.nodes()
+			  << " node(s), pool on node " << pool_node
+			  << (numa ? "" : ", threads not pinned") << std::endl;
+		std::cerr << "numa: read " << traffic.local
+			  << " bytes locally, " << traffic.remote
+			  << " remotely, local ratio "
+			  << (total ? 1.0 * traffic.local / total : 1.0)
+			  << std::endl;
+	}
 
 	auto result = std::accumulate(word_counts.begin(), word_counts.end(),
-					  word_count_kv{}, reduce);
+					  word_count_kv(dict.size(), 0), reduce);
 
-	for (const auto &e : result) {
-		std::cout << e.first << " " << e.second << std::endl;
+	for (std::size_t id = 0; id < result.size(); id++) {
+		if (result[id] != 0)
+			std::cout << dict.word(id).c_str() << " " << result[id]
+				  << std::endl;
 	}
 
 	pop.close();
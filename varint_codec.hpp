@@ -0,0 +1,107 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * varint_codec.hpp -- variable length encoding of unsigned integers, as
+ * a codec for segmented_array.
+ *
+ * Every value is stored in 7-bit groups, least significant first, with the
+ * top bit of a byte set if more follow. Word ids are handed out in the
+ * order words are first seen, so the frequent ones are small and most ids
+ * of a text take one or two bytes instead of four. Decoding is a byte loop
+ * with no tables, cheap next to a read from pmem.
+ */
+
+#ifndef VARINT_CODEC_HPP
+#define VARINT_CODEC_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace examples
+{
+
+template <typename T>
+struct varint_codec {
+	static_assert(std::is_unsigned<T>::value,
+		      "only unsigned integers can be encoded");
+
+	/* returns false if the encoded data would not be smaller */
+	static bool
+	encode(const T *data, std::size_t n, std::vector<uint8_t> &out)
+	{
+		out.clear();
+		out.reserve(n * 2);
+
+		for (std::size_t i = 0; i < n; i++) {
+			auto v = data[i];
+			while (v >= 0x80) {
+				out.push_back(uint8_t(v) | 0x80);
+				v >>= 7;
+			}
+			out.push_back(uint8_t(v));
+		}
+
+		return out.size() < n * sizeof(T);
+	}
+
+	/* throws std::runtime_error if in does not hold n values */
+	static void
+	decode(const uint8_t *in, std::size_t bytes, T *out, std::size_t n)
+	{
+		std::size_t pos = 0;
+
+		for (std::size_t i = 0; i < n; i++) {
+			T v = 0;
+			unsigned shift = 0;
+			uint8_t b;
+
+			do {
+				if (pos == bytes || shift >= sizeof(T) * 8)
+					throw std::runtime_error(
+						"corrupted varint data");
+				b = in[pos++];
+				v |= T(b & 0x7f) << shift;
+				shift += 7;
+			} while (b & 0x80);
+
+			out[i] = v;
+		}
+	}
+};
+
+} /* namespace examples */
+
+#endif /* VARINT_CODEC_HPP */
@@ -46,6 +46,8 @@
 #include <libpmemobj++/pool.hpp>
 #include <libpmemobj++/transaction.hpp>
 
+#include "pool_open.hpp"
+
 static const std::string LAYOUT = "warmup";
 
 using pmem::obj::delete_persistent;
@@ -79,7 +81,7 @@ main(int argc, char *argv[])
 
 	auto path = argv[1];
 
-	auto pop = pool<root>::open(path, LAYOUT);
+	auto pop = examples::open_pool<root>(path, LAYOUT);
 
 	std::cout << inc(pop) << std::endl;
 
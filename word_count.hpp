@@ -0,0 +1,108 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * word_count.hpp -- layout of the pool of simplekv_word_count, shared with
+ * the tools which work on it.
+ */
+
+#ifndef WORD_COUNT_HPP
+#define WORD_COUNT_HPP
+
+#include "ingest_journal.hpp"
+#include "pool_open.hpp"
+#include "segmented_array.hpp"
+#include "simplekv_optimized.hpp"
+#include "varint_codec.hpp"
+#include "word_dict.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <string>
+
+namespace examples
+{
+namespace word_count
+{
+
+namespace ptl = pmem::obj::experimental;
+
+using pmem::obj::make_persistent;
+using pmem::obj::persistent_ptr;
+using pmem::obj::pool;
+using pmem::obj::transaction;
+
+/*
+ * has to change whenever root, or anything it points to, changes its layout,
+ * so a pool created by an older version is rejected instead of misread
+ */
+static const std::string LAYOUT = "word_count_v2";
+
+/*
+ * every file is stored as a column of word ids from the dictionary, its
+ * segments optionally packed as varints
+ */
+using column_type = segmented_array<uint32_t, varint_codec<uint32_t>>;
+using kv_type = kv<ptl::string, persistent_ptr<column_type>, (1 << 20)>;
+using journal_type = ingest_journal<column_type>;
+
+struct root {
+	persistent_ptr<kv_type> simplekv;
+	persistent_ptr<word_dict::words_type> words;
+	persistent_ptr<journal_type> journal;
+};
+
+/* opens the pool, creating the data structures on first use */
+inline pool<root>
+open(const std::string &path)
+{
+	auto pop = examples::open_pool<root>(path, LAYOUT);
+	auto r = pop.root();
+
+	if (r->simplekv == nullptr) {
+		transaction::run(pop, [&]() {
+			r->simplekv = make_persistent<kv_type>();
+			r->words = make_persistent<word_dict::words_type>();
+			r->journal = make_persistent<journal_type>();
+		});
+	}
+
+	return pop;
+}
+
+} /* namespace word_count */
+} /* namespace examples */
+
+#endif /* WORD_COUNT_HPP */
@@ -0,0 +1,457 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * word_count_dump.cpp -- exports the pool of simplekv_word_count to a flat
+ * file and builds a new pool from such a file, so a dataset can be moved
+ * between machines (or pool layouts) without reading the texts again.
+ *
+ * usage:
+ *	word_count_dump dump pool-file dump-file
+ *	word_count_dump load pool-file dump-file
+ *
+ * The dump consists of:
+ *	dump_header
+ *	dictionary: uint64_t offsets[words + 1] of the words in the following
+ *		blob of characters
+ *	files: for every fully read file a dump_file followed by its path and
+ *		its word ids (uint32_t)
+ * Every part starts at an 8-byte boundary and numbers are stored in native
+ * byte order, so the dump can be used directly through mmap; the header
+ * records it and dumps of the other byte order are rejected. The checksum
+ * covers the whole file, with the checksum field set to zero. It is built
+ * like Fletcher's, from a sum of the 32-bit words and a sum of those sums,
+ * but both are taken mod 2^32, so it is not Fletcher-64.
+ *
+ * Loading requires an empty pool. The whole dump is validated first (the
+ * dictionary offsets, sizes and word ids), so nothing is allocated for a
+ * corrupted one. The word ids are then copied straight from the mapped
+ * dump to reserved segments, with non-temporal stores. The dictionary and
+ * every file are added in separate transactions, so a load which fails or
+ * is interrupted leaves a partially filled pool behind: it is refused by
+ * the next load and has to be recreated before loading again.
+ */
+
+#include "word_count.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using pmem::obj::make_persistent;
+using pmem::obj::pool;
+using pmem::obj::transaction;
+
+using examples::word_count::column_type;
+using examples::word_count::root;
+using reservation_type = column_type::reservation;
+
+static const char MAGIC[8] = {'W', 'C', 'D', 'U', 'M', 'P', 0, 0};
+static const uint64_t VERSION = 2;
+
+/* reads differently if the dump was written with the other byte order */
+static const uint64_t ENDIAN_MARK = 0x0102030405060708ULL;
+
+/* number of words added to the dictionary in a single transaction */
+static const std::size_t BATCH_WORDS = 1 << 16;
+
+/* maximum size of a segment of a loaded file, in word ids */
+static const std::size_t SEGMENT_IDS = 1 << 20;
+
+struct dump_header {
+	char magic[8];
+	uint64_t byte_order;
+	uint64_t version;
+	uint64_t size; /* of the whole dump */
+	uint64_t checksum;
+	uint64_t words;
+	uint64_t files;
+};
+
+struct dump_file {
+	uint64_t path_size;
+	uint64_t size;	/* of the text file, as in ingest_journal */
+	uint64_t mtime; /* of the text file, as in ingest_journal */
+	uint64_t ids;
+};
+
+static uint64_t
+align8(uint64_t off)
+{
+	return (off + 7) & ~7ULL;
+}
+
+/*
+ * Two running sums of the 32-bit words of the dump, mod 2^32, with the
+ * checksum field read as zero
+ */
+static uint64_t
+checksum(const void *addr, std::size_t size)
+{
+	auto words = static_cast<const uint32_t *>(addr);
+	auto skip = offsetof(dump_header, checksum) / sizeof(uint32_t);
+	uint32_t lo = 0;
+	uint32_t hi = 0;
+
+	for (std::size_t i = 0; i < size / sizeof(uint32_t); i++) {
+		lo += (i == skip || i == skip + 1) ? 0 : words[i];
+		hi += lo;
+	}
+
+	return static_cast<uint64_t>(hi) << 32 | lo;
+}
+
+/* whole file mapped into memory */
+class mapping {
+public:
+	mapping(const std::string &path, bool writable)
+	{
+		int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+		if (fd < 0)
+			throw std::runtime_error("cannot open " + path);
+
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			throw std::runtime_error("cannot stat " + path);
+		}
+
+		size = static_cast<std::size_t>(st.st_size);
+		addr = mmap(nullptr, size,
+			    writable ? PROT_READ | PROT_WRITE : PROT_READ,
+			    MAP_SHARED, fd, 0);
+		::close(fd);
+
+		if (addr == MAP_FAILED)
+			throw std::runtime_error("cannot map " + path);
+	}
+
+	mapping(const mapping &) = delete;
+	mapping &operator=(const mapping &) = delete;
+
+	~mapping()
+	{
+		munmap(addr, size);
+	}
+
+	template <typename T>
+	const T *
+	at(uint64_t off, uint64_t n = 1) const
+	{
+		if (off > size || n > (size - off) / sizeof(T))
+			throw std::runtime_error("dump is truncated");
+
+		return reinterpret_cast<const T *>(
+			static_cast<const char *>(addr) + off);
+	}
+
+	void *addr;
+	std::size_t size;
+};
+
+class dump_writer {
+public:
+	dump_writer(const std::string &path)
+	    : path(path), out(path, std::ios::binary | std::ios::trunc)
+	{
+		if (!out)
+			throw std::runtime_error("cannot create " + path);
+	}
+
+	void
+	write(const void *data, std::size_t n)
+	{
+		out.write(static_cast<const char *>(data), n);
+		off += n;
+	}
+
+	void
+	pad()
+	{
+		static const char zeros[8] = {};
+		write(zeros, align8(off) - off);
+	}
+
+	/* fills in the size and checksum */
+	void
+	finish()
+	{
+		out.close();
+		if (!out)
+			throw std::runtime_error("cannot write " + path);
+
+		mapping m(path, true);
+		auto hdr = static_cast<dump_header *>(m.addr);
+		hdr->size = m.size;
+		hdr->checksum = checksum(m.addr, m.size);
+
+		if (msync(m.addr, m.size, MS_SYNC) != 0)
+			throw std::runtime_error("cannot write " + path);
+	}
+
+	uint64_t off = 0;
+
+private:
+	std::string path;
+	std::ofstream out;
+};
+
+void
+dump(pool<root> &pop, const std::string &path)
+{
+	auto r = pop.root();
+	const auto &words = *r->words;
+	const auto &entries = r->journal->all();
+	std::vector<uint32_t> buf;
+
+	dump_header hdr = {};
+	std::memcpy(hdr.magic, MAGIC, sizeof(MAGIC));
+	hdr.byte_order = ENDIAN_MARK;
+	hdr.version = VERSION;
+	hdr.words = words.size();
+	for (const auto &e : entries)
+		hdr.files += e->done != 0;
+
+	dump_writer out(path);
+	out.write(&hdr, sizeof(hdr));
+
+	uint64_t off = 0;
+	for (std::size_t i = 0; i < words.size(); i++) {
+		out.write(&off, sizeof(off));
+		off += words[i].size();
+	}
+	out.write(&off, sizeof(off));
+
+	for (std::size_t i = 0; i < words.size(); i++)
+		out.write(words[i].c_str(), words[i].size());
+	out.pad();
+
+	for (const auto &e : entries) {
+		if (!e->done)
+			continue;
+
+		dump_file f = {e->path.size(), e->size, e->mtime,
+			       e->data->size()};
+		out.write(&f, sizeof(f));
+		out.write(e->path.c_str(), f.path_size);
+		out.pad();
+
+		e->data->for_each_run(buf, [&](const uint32_t *ids,
+					       std::size_t n) {
+			out.write(ids, n * sizeof(uint32_t));
+		});
+		out.pad();
+	}
+
+	out.finish();
+
+	std::cout << "dumped " << hdr.words << " words and " << hdr.files
+		  << " files (" << out.off << " bytes)" << std::endl;
+}
+
+/* parts of a validated dump */
+struct dump_contents {
+	const dump_header *hdr;
+	const uint64_t *offsets;
+	const char *blob;
+
+	struct file {
+		const dump_file *info;
+		const char *path;
+		const uint32_t *ids;
+	};
+	std::vector<file> files;
+};
+
+/* throws std::runtime_error unless the whole dump is well formed */
+static dump_contents
+parse(const mapping &m)
+{
+	dump_contents d;
+
+	auto hdr = d.hdr = m.at<dump_header>(0);
+	if (std::memcmp(hdr->magic, MAGIC, sizeof(MAGIC)) != 0)
+		throw std::runtime_error("not a word count dump");
+	if (hdr->byte_order != ENDIAN_MARK)
+		throw std::runtime_error("dump has a different byte order");
+	if (hdr->version != VERSION)
+		throw std::runtime_error("unsupported dump version");
+	if (hdr->size != m.size)
+		throw std::runtime_error("dump is truncated");
+	if (hdr->checksum != checksum(m.addr, m.size))
+		throw std::runtime_error("dump checksum mismatch");
+	if (hdr->words > UINT32_MAX)
+		throw std::runtime_error("too many words in dump");
+
+	uint64_t off = sizeof(dump_header);
+	d.offsets = m.at<uint64_t>(off, hdr->words + 1);
+	off += (hdr->words + 1) * sizeof(uint64_t);
+
+	if (d.offsets[0] != 0)
+		throw std::runtime_error("corrupted dump dictionary");
+	for (uint64_t i = 0; i < hdr->words; i++) {
+		if (d.offsets[i + 1] < d.offsets[i])
+			throw std::runtime_error("corrupted dump dictionary");
+	}
+
+	d.blob = m.at<char>(off, d.offsets[hdr->words]);
+	off = align8(off + d.offsets[hdr->words]);
+
+	for (uint64_t n = 0; n < hdr->files; n++) {
+		dump_contents::file f;
+		f.info = m.at<dump_file>(off);
+		off += sizeof(dump_file);
+		f.path = m.at<char>(off, f.info->path_size);
+		off = align8(off + f.info->path_size);
+		f.ids = m.at<uint32_t>(off, f.info->ids);
+		off = align8(off + f.info->ids * sizeof(uint32_t));
+
+		for (uint64_t i = 0; i < f.info->ids; i++) {
+			if (f.ids[i] >= hdr->words)
+				throw std::runtime_error(
+					"word id out of range in dump");
+		}
+
+		d.files.push_back(f);
+	}
+
+	return d;
+}
+
+void
+load(pool<root> &pop, const std::string &path)
+{
+	auto r = pop.root();
+	if (r->words->size() != 0 || r->journal->all().size() != 0)
+		throw std::runtime_error(
+			"the pool is not empty, load needs a new one");
+
+	mapping m(path, false);
+
+	auto d = parse(m);
+	auto hdr = d.hdr;
+	auto offsets = d.offsets;
+	auto blob = d.blob;
+
+	auto &words = *r->words;
+	for (uint64_t first = 0; first < hdr->words; first += BATCH_WORDS) {
+		auto last = std::min(hdr->words, first + BATCH_WORDS);
+
+		transaction::run(pop, [&] {
+			if (first == 0)
+				words.reserve(hdr->words);
+
+			for (auto i = first; i < last; i++)
+				words.emplace_back(blob + offsets[i],
+						   offsets[i + 1] - offsets[i]);
+		});
+	}
+
+	for (const auto &file : d.files) {
+		auto f = file.info;
+		auto ids = file.ids;
+		std::string fname(file.path, f->path_size);
+
+		std::vector<std::unique_ptr<reservation_type>> segments;
+		for (uint64_t i = 0; i < f->ids; i += SEGMENT_IDS) {
+			auto len = std::min<uint64_t>(SEGMENT_IDS, f->ids - i);
+			segments.emplace_back(
+				new reservation_type(pop, ids + i, len));
+		}
+
+		transaction::run(pop, [&] {
+			auto entry = r->journal->add(
+				fname, examples::file_id{f->size, f->mtime});
+			entry->data = make_persistent<column_type>();
+			for (auto &s : segments)
+				entry->data->append(*s);
+
+			r->simplekv->insert(entry->path, entry->data);
+			entry->offset = f->size;
+			entry->done = 1;
+		});
+	}
+
+	std::cout << "loaded " << hdr->words << " words and " << hdr->files
+		  << " files" << std::endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 4) {
+		std::cerr << "usage: " << argv[0]
+			  << " dump|load pool-file dump-file" << std::endl;
+		return 1;
+	}
+
+	std::string op = argv[1];
+	if (op != "dump" && op != "load") {
+		std::cerr << "unknown operation " << op << std::endl;
+		return 1;
+	}
+
+	auto pop = examples::word_count::open(argv[2]);
+	auto start = std::chrono::steady_clock::now();
+
+	try {
+		if (op == "dump")
+			dump(pop, argv[3]);
+		else
+			load(pop, argv[3]);
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		pop.close();
+		return 1;
+	}
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+	std::cout << "took " << elapsed.count() << "s" << std::endl;
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * word_dict.hpp -- persistent dictionary mapping words to dense 32-bit ids.
+ *
+ * The id -> word mapping is stored in the pool, the word -> id index is
+ * volatile and rebuilt from it whenever the dictionary is opened.
+ */
+
+#ifndef WORD_DICT_HPP
+#define WORD_DICT_HPP
+
+#include <libpmemobj++/experimental/string.hpp>
+#include <libpmemobj++/experimental/vector.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace examples
+{
+
+namespace ptl = pmem::obj::experimental;
+
+using pmem::obj::persistent_ptr;
+
+class word_dict {
+public:
+	using words_type = ptl::vector<ptl::string>;
+
+	explicit word_dict(persistent_ptr<words_type> words) : words(words)
+	{
+		const words_type &w = *words;
+
+		ids.reserve(w.size());
+		for (std::size_t i = 0; i < w.size(); i++)
+			ids.emplace(w[i].c_str(), i);
+	}
+
+	/*
+	 * Returns id of the word, appending it to the dictionary if it's not
+	 * there yet. Has to be called inside a transaction; if that
+	 * transaction aborts the dictionary has to be opened again.
+	 */
+	uint32_t
+	intern(const std::string &word)
+	{
+		auto it = ids.find(word);
+		if (it != ids.end())
+			return it->second;
+
+		if (words->size() == UINT32_MAX)
+			throw std::length_error("word dictionary is full");
+
+		auto id = static_cast<uint32_t>(words->size());
+		words->emplace_back(word);
+		ids.emplace(word, id);
+
+		return id;
+	}
+
+	const ptl::string &
+	word(uint32_t id) const
+	{
+		const words_type &w = *words;
+		return w[id];
+	}
+
+	std::size_t
+	size() const
+	{
+		return words->size();
+	}
+
+private:
+	persistent_ptr<words_type> words;
+	std::unordered_map<std::string, uint32_t> ids;
+};
+
+} /* namespace examples */
+
+#endif /* WORD_DICT_HPP */